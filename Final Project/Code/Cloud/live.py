@@ -0,0 +1,72 @@
+# live updates for open dashboards, streamed as server-sent events
+#
+# Ingest publishes each change (new speed point, dash lights, summary) to the feed of its vehicle: one JSON
+# encoding and one append to a fixed size ring, whatever the number of viewers. Each viewer wakes up at most every
+# interval_s, takes everything newer than what it last sent and sends it as one message. While samples stream in,
+# viewers are mostly sleeping rather than waiting, so publishing rarely has anyone to wake up
+import json
+import threading
+import time
+from collections import deque
+from itertools import islice
+
+# sent in place of the events a viewer missed when it fell further behind than the ring reaches
+GAP = json.dumps({"type": "gap"})
+
+
+class LiveFeed:
+    def __init__(self, capacity=1024):
+        # (sequence number, JSON text) of the latest events, oldest first
+        self.events = deque(maxlen=capacity)
+        self.seq = 0
+        self.changed = threading.Condition()
+
+        # newest event of each state kind (e.g. the dash lights), kept apart from the ring so a viewer that fell
+        # behind still gets the current state
+        self.state = {}
+
+    # state names the kind of event if it describes a current state, so only the newest one matters
+    def publish(self, event, state=None):
+        text = json.dumps(event)
+        with self.changed:
+            self.seq += 1
+            self.events.append((self.seq, text))
+            if state is not None:
+                self.state[state] = (self.seq, text)
+            self.changed.notify_all()
+
+    # JSON texts of the events after seq and the sequence number to continue from. A viewer that fell behind
+    # further than the ring reaches gets GAP, the newest state events it missed and whatever the ring still has
+    def since(self, seq, timeout_s):
+        with self.changed:
+            if self.seq == seq:
+                self.changed.wait(timeout_s)
+            if self.seq == seq:
+                return [], seq
+
+            if self.events and self.events[0][0] <= seq + 1:
+                # walked from the newest end so it only touches the new events
+                new = [text for _, text in islice(reversed(self.events), self.seq - seq)]
+                new.reverse()
+                return new, self.seq
+
+            oldest = self.events[0][0] if self.events else self.seq + 1
+            missed = [text for state_seq, text in self.state.values() if seq < state_seq < oldest]
+            return [GAP] + missed + [text for _, text in self.events], self.seq
+
+    # generator of server-sent event messages for one viewer, each with its seq as the event id. since is the
+    # seq the viewer has everything up to (None = start with what's published from now on), continued through
+    # since() so a viewer asking for more than the ring still has gets GAP
+    def stream(self, since=None, interval_s=0.5, keep_alive_s=15):
+        seq = self.seq if since is None else since
+        if not 0 <= seq <= self.seq:
+            # from before the server restarted, nothing it had can be continued
+            seq = -1
+        while True:
+            texts, seq = self.since(seq, keep_alive_s)
+            if not texts:
+                # comment line so proxies don't drop the idle connection
+                yield ": keep-alive\n\n"
+                continue
+            yield f"id: {seq}\ndata: [{','.join(texts)}]\n\n"
+            time.sleep(interval_s)
@@ -0,0 +1,147 @@
+# load test for the ingest path: posts batches of raw samples to a local copy of server.py and prints the
+# request latency for every tenth of the run, which should stay flat as the stored history grows
+#
+#   flask --app server run --port 8080   (PushBullet token doesn't matter, the samples stay under 70 mph)
+#   python3 load_test.py --samples 1000000
+#
+# --in-process skips HTTP and times TimeSeries.append directly, next to the old DataFrame concat if pandas is there
+#
+# --notify fast|slow|down also runs a stand-in for the notification service and sends samples that flip dash lights
+# and cross the speed limit, ingest latency should be the same for all three:
+#
+#   NOTIFY_URL=http://127.0.0.1:8090/ flask --app server run --port 8080
+#   python3 load_test.py --samples 100000 --notify slow
+import argparse
+import http.client
+import http.server
+import socket
+import threading
+import time
+
+
+def percentiles(latencies):
+    ordered = sorted(latencies)
+    return ordered[len(ordered) // 2], ordered[int(len(ordered) * 0.99)], ordered[-1]
+
+
+def report(chunk, done, total, latencies, unit):
+    p50, p99, worst = percentiles(latencies)
+    print(f"{chunk:3d}: {done:9d}/{total} samples  p50 {p50 * 1e6:9.1f} us  p99 {p99 * 1e6:9.1f} us  "
+          f"max {worst * 1e6:9.1f} us per {unit}")
+
+
+# notification service stand-in: fast answers right away, slow takes 2 s per push, down accepts connections
+# and never answers
+class StandIn(http.server.BaseHTTPRequestHandler):
+    mode = "fast"
+    received = 0
+
+    def do_POST(self):
+        self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        StandIn.received += 1
+        if StandIn.mode == "slow":
+            time.sleep(2)
+        self.send_response(200)
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+
+def start_stand_in(mode, port):
+    StandIn.mode = mode
+    if mode == "down":
+        hole = socket.socket()
+        hole.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        hole.bind(("127.0.0.1", port))
+        hole.listen(64)
+        return hole
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", port), StandIn)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+def run_http(host, port, total, batch, vehicles, notify):
+    connection = http.client.HTTPConnection(host, port)
+    sent = 0
+    sender_ms = 0
+    chunk = 0
+    latencies = []
+    while sent < total:
+        lines = []
+        for _ in range(batch):
+            sender_ms += 1
+            vehicle = f"02000000{sender_ms % vehicles:04x}"
+            if notify:
+                # every vehicle flips a light and crosses 70 mph a few times per batch
+                lines.append(f"{vehicle},{sender_ms},0,{sender_ms // 16 % 2},{sender_ms % 80}")
+            else:
+                # lights off and speed under the limit so no notifications go out
+                lines.append(f"{vehicle},{sender_ms},0,0,{sender_ms % 60}")
+        body = "\n".join(lines) + "\n"
+
+        start = time.perf_counter()
+        connection.request("POST", "/batch", body, {"Content-Type": "text/csv"})
+        response = connection.getresponse()
+        response.read()
+        latencies.append(time.perf_counter() - start)
+        if response.status != 200:
+            raise SystemExit(f"server answered {response.status}")
+
+        sent += batch
+        if sent * 10 // total > chunk or sent >= total:
+            chunk += 1
+            report(chunk, sent, total, latencies, f"{batch} sample request")
+            latencies = []
+
+
+def run_in_process(total):
+    from timeseries import TimeSeries
+
+    series = TimeSeries()
+    t = time.time()
+    latencies = []
+    chunk = 0
+    for i in range(total):
+        start = time.perf_counter()
+        series.append(t + i, i % 60)
+        latencies.append(time.perf_counter() - start)
+        if (i + 1) * 10 // total > chunk:
+            chunk += 1
+            report(chunk, i + 1, total, latencies, "append")
+            latencies = []
+
+    try:
+        import pandas as pd
+    except ImportError:
+        return
+    # the old way, only up to 20k samples since it gets quadratically slower
+    df = pd.DataFrame(columns=["time", "speed"])
+    for n in (1000, 10000, 20000):
+        while len(df) < n:
+            start = time.perf_counter()
+            df = pd.concat([df, pd.DataFrame({"time": [t], "speed": [0]})], ignore_index=True)
+            took = time.perf_counter() - start
+        print(f"DataFrame concat at {n:6d} rows: {took * 1e6:9.1f} us per append")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="ingest latency over a long run")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--samples", type=int, default=1000000)
+    parser.add_argument("--batch", type=int, default=64, help="samples per POST (the devkitV1 sends up to 64)")
+    parser.add_argument("--vehicles", type=int, default=8)
+    parser.add_argument("--in-process", action="store_true")
+    parser.add_argument("--notify", choices=["fast", "slow", "down"],
+                        help="run a notification stand-in that behaves like this (start the server with NOTIFY_URL)")
+    parser.add_argument("--notify-port", type=int, default=8090)
+    args = parser.parse_args()
+
+    if args.in_process:
+        run_in_process(args.samples)
+    else:
+        stand_in = start_stand_in(args.notify, args.notify_port) if args.notify else None
+        run_http(args.host, args.port, args.samples, args.batch, args.vehicles, args.notify)
+        if args.notify:
+            print(f"stand-in got {StandIn.received} notifications")
@@ -0,0 +1,76 @@
+# background sender for the mobile notifications, so a slow or unreachable push service never holds up ingest
+#
+# notify() only files the message and returns. Messages of one vehicle are held for a short window and go out as
+# one push, a newer message with the same key (e.g. the same dash light flipping again) replaces the older one.
+# One worker thread does the pushing, so there's never more than one push in flight, and the number of vehicles
+# waiting is capped; anything beyond that is dropped and counted
+import threading
+import time
+from collections import OrderedDict
+
+
+class Notifier:
+    def __init__(self, push, title="Vehicle Notification", window_s=2.0, max_pending=256):
+        self.push = push  # push(title, body), may block or raise
+        self.title = title
+        self.window_s = window_s
+        self.max_pending = max_pending
+
+        # vehicle -> (time it goes out, OrderedDict of key -> message), oldest vehicle first
+        self.pending = OrderedDict()
+        self.lock = threading.Lock()
+        self.wake = threading.Condition(self.lock)
+
+        self.stats = {
+            "queued": 0,
+            "merged": 0,
+            "dropped": 0,
+            "sent": 0,
+            "failed": 0
+        }
+
+        threading.Thread(target=self._run, daemon=True).start()
+
+    # files a message about a vehicle, never blocks on the push service
+    def notify(self, vehicle, key, message):
+        with self.lock:
+            self.stats["queued"] += 1
+            if vehicle in self.pending:
+                messages = self.pending[vehicle][1]
+                if key in messages:
+                    self.stats["merged"] += 1
+                    del messages[key]  # goes to the end, in the order things happened
+                messages[key] = message
+                return
+
+            if len(self.pending) >= self.max_pending:
+                self.stats["dropped"] += 1
+                return
+
+            self.pending[vehicle] = (time.monotonic() + self.window_s, OrderedDict([(key, message)]))
+            self.wake.notify()
+
+    def _run(self):
+        while True:
+            with self.lock:
+                while not self.pending:
+                    self.wake.wait()
+
+                # vehicles were added in order, so the first one is due first
+                vehicle, (due, messages) = next(iter(self.pending.items()))
+                wait_s = due - time.monotonic()
+                if wait_s > 0:
+                    self.wake.wait(wait_s)
+                    continue
+                del self.pending[vehicle]
+
+            # outside the lock, notify() keeps filing (and merging) while this is in flight
+            try:
+                self.push(self.title, "\n".join(messages.values()))
+                sent = True
+            except Exception as error:
+                print(f"Notification for {vehicle} failed: {error}")
+                sent = False
+
+            with self.lock:
+                self.stats["sent" if sent else "failed"] += 1
@@ -1,118 +1,422 @@
 # libs for handling flask serverr
-from flask import Flask, request, render_template
-from datetime import datetime
+from flask import Flask, request, render_template, jsonify, Response
+from datetime import datetime, timedelta
+from collections import deque
+from werkzeug.serving import WSGIRequestHandler
+from werkzeug.utils import secure_filename
+import threading
+from time import sleep
 
 # libs for handling speed graph
 import os
-import shutil
-import pandas as pd
+import matplotlib
+matplotlib.use("Agg")  # drawn from a background thread, no window
 import matplotlib.pyplot as plt
 import matplotlib.dates as mdates
 import matplotlib.style as style
 
+# fixed size per vehicle speed history (raw points plus minute/hour averages)
+from timeseries import TimeSeries, decimate
+
+# streams new samples to open dashboards
+from live import LiveFeed
+
 # lib for handling mobile notifications
 from pushbullet import Pushbullet
+import json
+import urllib.request
+
+# queues notifications and sends them from a background thread
+from notifier import Notifier
+
+# NOTIFY_URL points the notifications at a local stand-in (load_test.py --notify) instead of PushBullet, each one is
+# POSTed there as JSON {"title": ..., "body": ...}
+NOTIFY_URL = os.environ.get("NOTIFY_URL")
+
+if NOTIFY_URL:
+    def push_note(title, body):
+        data = json.dumps({"title": title, "body": body}).encode()
+        post = urllib.request.Request(NOTIFY_URL, data, {"Content-Type": "application/json"})
+        urllib.request.urlopen(post, timeout=5).close()
+else:
+    # takes in API token retrieved on PushBullet site settings after login
+    pb = Pushbullet('REDACTED')
+    push_note = pb.push_note
+
+# messages of one vehicle within 2 s go out as one push
+notifier = Notifier(push_note, window_s=2.0)
+
+# stores speed/time data of each vehicle for producing graph on dashboard, appending is constant time and the
+# memory use is fixed no matter how long the server runs
+speed_series = {}
+
+# the plot renderer reads the series from its own thread while requests append to them
+series_lock = threading.Lock()
+
+def series_for(vehicle):
+    if vehicle not in speed_series:
+        speed_series[vehicle] = TimeSeries()
+    return speed_series[vehicle]
 
-# takes in API token retrieved on PushBullet site settings after login
-pb = Pushbullet('REDACTED')
+# how many points the PNG plot and /speed.json draw at most, whatever the history length
+PLOT_POINTS = 300
+PLOT_POINTS_MAX = 2000
 
-# stores speed/time data for producing graph on dashboard
-df = pd.DataFrame(columns=["time", "speed"])
+# the renderer draws a vehicle's plot at most this often, however fast samples come in
+PLOT_INTERVAL_S = 2
+
+# per vehicle: how many samples its series had when its plot was last drawn (also the ?v= of the PNG, so browsers
+# don't keep a stale copy)
+plot_versions = {}
+
+# set whenever a sample comes in, wakes up the renderer
+plot_wanted = threading.Event()
+
+# per vehicle feed of what changed, for the dashboards watching it live
+live_feeds = {}
+
+def feed_for(vehicle):
+    if vehicle not in live_feeds:
+        live_feeds[vehicle] = LiveFeed()
+    return live_feeds[vehicle]
 
 app = Flask(__name__)
 
-# Variables to store last pulled values
-last_speed = None
-notified = False
+# answer with HTTP/1.1 so the devkitV1 can keep one connection open instead of reconnecting per sample
+WSGIRequestHandler.protocol_version = "HTTP/1.1"
 
-# maintains status of dash lights as it's received 
-dash_lights = {
-    "engine_light": "OFF",
-    "tire_light": "OFF",
-    "oil_light": "OFF",
-    "battery_light": "OFF"
-}
+# vehicle ID used by the single-sample "/" route, which doesn't send one
+DEFAULT_VEHICLE = "default"
+
+# per vehicle (keyed by the sender MAC the devkitV1 reports): last pulled values and status of dash lights
+# as it's received
+vehicles = {}
+
+# vehicle whose data came in last, shown by /serve when no vehicle is picked
+last_vehicle = None
+
+# state of a vehicle nothing has been heard from yet
+def new_vehicle_state():
+    return {
+        "last_speed": None,
+        "notified": False,
+        "dash_lights": {
+            "engine_light": "OFF",
+            "tire_light": "OFF",
+            "oil_light": "OFF",
+            "battery_light": "OFF"
+        },
+        # never used; tracks the last time each dash light status changed
+        "dash_update_stamp": {
+            "engine_light": "Unknown",
+            "tire_light": "Unknown",
+            "oil_light": "Unknown",
+            "battery_light": "Unknown"
+        }
+    }
 
-# never used; tracks the last time each dash light status changed
-dash_update_stamp = {
-    "engine_light": "Unknown",
-    "tire_light": "Unknown",
-    "oil_light": "Unknown",
-    "battery_light": "Unknown"
+# state of a vehicle data came in for, added on its first sample
+def vehicle_state(vehicle):
+    if vehicle not in vehicles:
+        vehicles[vehicle] = new_vehicle_state()
+    return vehicles[vehicle]
+
+# the vehicle a dashboard route was asked for (?vehicle=<id>, defaults to the one heard from last) and its state,
+# without adding it: None for an id nothing was heard from. DEFAULT_VEHICLE always has one (all lights off until
+# the single-sample route sends), so a fresh server still shows a dashboard
+def viewed_vehicle():
+    vehicle = request.args.get("vehicle", default=last_vehicle or DEFAULT_VEHICLE)
+    if vehicle == DEFAULT_VEHICLE:
+        return vehicle, vehicles.get(vehicle, new_vehicle_state())
+    return vehicle, vehicles.get(vehicle)
+
+# which dash light each bit of the lights bitmask in a batch line is (LIGHT_* in lib/VehicleFrame/VehicleFrame.h)
+light_bits = ["engine_light", "tire_light", "oil_light", "battery_light"]
+
+# what happened in an "E" batch line, bits of its events field (SAMPLE_EVENT_* in lib/SampleBatch/SampleBatch.h)
+EVENT_LIGHTS = 1 << 0
+EVENT_SPEEDING = 1 << 1
+EVENT_SPEED_OK = 1 << 2
+
+# (vehicle, sender time stamp) of recently ingested batch samples, so a batch retried by the devkitV1 isn't
+# counted twice
+recent_samples = deque(maxlen=256)
+
+# ESP-NOW link counters reported by the devkitV1 with each batch (how many frames made it from the TTGO)
+link_stats = {
+    "received": 0,
+    "duplicates": 0,
+    "out_of_order": 0,
+    "lost": 0,
+    "vehicles": 0
 }
 
+# where a vehicle's speed plot goes, relative to the static folder
+def plot_file(vehicle):
+    return f"generated/speed_plot_{secure_filename(vehicle)}.png"
+
 # produces the speed/time graph for the dashboard (saves it as png on server side, which is later pulled by HTML)
-def save_speed_plot(df):
+def save_speed_plot(vehicle, times, speeds):
     style.use('dark_background')
 
     plt.figure()
-    plt.plot(df["time"], df["speed"], marker='o')
+    plt.plot([datetime.fromtimestamp(t) for t in times], speeds, marker='o')
     plt.xticks(rotation=45)
     plt.tight_layout()
 
     ax = plt.gca()
     ax.xaxis.set_major_formatter(mdates.DateFormatter('%I:%M %p'))
 
-    temp_path = "temp_plot.png"
-    destination_folder = "static/generated"
-    destination_file = os.path.join(destination_folder, "speed_plot.png")
+    destination_file = os.path.join("static", plot_file(vehicle))
+    temp_path = destination_file + ".tmp"
 
-    plt.savefig(temp_path)
+    os.makedirs(os.path.dirname(destination_file), exist_ok=True)
+    plt.savefig(temp_path, format="png")
     plt.close()
 
-    os.makedirs(destination_folder, exist_ok=True)
-    shutil.move(temp_path, destination_file)
+    # swapped in whole so a page loading at the same time never gets half a PNG
+    os.replace(temp_path, destination_file)
 
-# route for handling data input
-@app.route("/")
-def update():
-    # values that should be updated globally, mainly df which is dataframe updating speed/time data
-    global last_speed, df, notified
+# background thread redrawing the plot of every vehicle that got new samples since its last drawing, so page
+# loads only ever hand out the file that's already there
+def render_plots():
+    while True:
+        plot_wanted.wait()
+        plot_wanted.clear()
 
-    data = request.args.to_dict()
+        for vehicle in list(speed_series.keys()):
+            with series_lock:
+                series = speed_series[vehicle]
+                version = len(series)
+                if plot_versions.get(vehicle) == version:
+                    continue
+                times, speeds, _, _ = decimate(series.query(), PLOT_POINTS)
 
-    if len(data) == 0:
-        return "Error: No arguments found."
+            save_speed_plot(vehicle, times, speeds)
+            plot_versions[vehicle] = version
+
+        sleep(PLOT_INTERVAL_S)
+
+threading.Thread(target=render_plots, daemon=True).start()
+
+# records one speed sample (and any dash light updates) of a vehicle taken at the given time. speeding comes from
+# the devkitV1 when it aggregates on its own, otherwise it's worked out from the speed here
+def ingest_sample(vehicle, time, speed, lights, speeding=None):
+    global last_vehicle
+
+    state = vehicle_state(vehicle)
+    last_vehicle = vehicle
+    state["last_speed"] = speed
 
-    last_speed = float(request.args.get('speed'))
+    if speeding is None:
+        speeding = speed >= 70
 
     # sends notification if user goes over 70
-    if (last_speed >= 70 and not notified):
-        notified = True
-        pb.push_note("Vehicle Notification", "The driver is speeding over 70 mph")
+    if (speeding and not state["notified"]):
+        state["notified"] = True
+        notifier.notify(vehicle, "speeding", f"The driver of {vehicle} is speeding over 70 mph")
 
     # ensures that notification is only sent once when driver passes 70, not on every iteration
-    if (notified and last_speed < 70):
-        notified = False
+    if (state["notified"] and not speeding):
+        state["notified"] = False
 
-    new_row = pd.DataFrame({
-        "time": [datetime.utcnow()],
-        "speed": [last_speed]
-    })
-
-    df = pd.concat([df, new_row], ignore_index=True)
+    # published under the lock too, so /speed.json's seq tells exactly which points its answer already has
+    with series_lock:
+        series_for(vehicle).append(time.timestamp(), speed)
+        feed_for(vehicle).publish({"type": "speed", "t": round(time.timestamp() * 1000), "speed": speed})
+    plot_wanted.set()
 
     # goes through the dashlight data if sent by Devkit V1
+    dash_lights = state["dash_lights"]
+    changed = False
     for key in dash_lights.keys():
-        if key in data:
-            dash_lights[key] = data[key]
+        if key in lights:
+            dash_lights[key] = lights[key]
+            changed = True
             # currently left in UTC format
-            dash_update_stamp[key] = datetime.utcnow().strftime("%m/%d/%y %I:%M %p UTC")
+            state["dash_update_stamp"][key] = time.strftime("%m/%d/%y %I:%M %p UTC")
 
             # send mobile notification updating car owner about dash light turning on/off
-            pb.push_note("Vehicle Notification", f"{key} is now {data[key]}.")
+            notifier.notify(vehicle, key, f"{key} of {vehicle} is now {lights[key]}.")
+
+    if changed:
+        feed_for(vehicle).publish({"type": "lights", "lights": dict(dash_lights)}, state="lights")
+
+# records the speed statistics of one window the devkitV1 summarized (it only sends samples when something happened)
+def ingest_summary(vehicle, start, end, samples, min_speed, max_speed, mean_speed, over_limit_ms):
+    global last_vehicle
+
+    state = vehicle_state(vehicle)
+    last_vehicle = vehicle
+    state["summary"] = {
+        "start": start,
+        "end": end,
+        "samples": samples,
+        "min": min_speed,
+        "max": max_speed,
+        "mean": mean_speed,
+        "over_limit_s": over_limit_ms / 1000
+    }
+
+    # the graph gets the window's mean at the time of its last reading
+    summary = {key: value for key, value in state["summary"].items() if key not in ("start", "end")}
+    feed_for(vehicle).publish({"type": "summary", "summary": summary}, state="summary")
+    with series_lock:
+        series_for(vehicle).append(end.timestamp(), float(mean_speed))
+        feed_for(vehicle).publish({"type": "speed", "t": round(end.timestamp() * 1000), "speed": float(mean_speed)})
+    plot_wanted.set()
+
+# route for handling data input
+@app.route("/")
+def update():
+    data = request.args.to_dict()
+
+    if len(data) == 0:
+        return "Error: No arguments found."
+
+    ingest_sample(DEFAULT_VEHICLE, datetime.utcnow(), float(request.args.get('speed')), data)
 
     return "Data has been successfully updated"
 
-# route for serving dashboard page
+# route for handling a batch of samples buffered by the Devkit V1, one per line:
+# "<vehicle>,<sender ms>,<age ms>,<lights>,<speed>" a raw sample, where vehicle is the sender's MAC, age is how
+#     long before the request it was received and lights is a bitmask of the dash lights that are on (see light_bits)
+# "E,<vehicle>,<sender ms>,<age ms>,<lights>,<speed>,<events>" a sample where something happened, events is a
+#     bitmask of what (see EVENT_*)
+# "S,<vehicle>,<start age ms>,<end age ms>,<samples>,<min>,<max>,<mean>,<ms over limit>" speed statistics of a
+#     window of samples the devkitV1 kept to itself
+@app.route("/batch", methods=["POST"])
+def update_batch():
+    now = datetime.utcnow()
+    lines = request.get_data(as_text=True).splitlines()
+
+    if len(lines) == 0:
+        return "Error: No samples found.", 400
+
+    # link counters ride along in the query string, keep the last ones for the dashboard
+    for key in link_stats:
+        link_stats[key] = request.args.get(key, default=link_stats[key], type=int)
+
+    ingested = 0
+    for line in lines:
+        fields = line.split(",")
+
+        # summaries aren't de-duplicated, a retried batch only adds the same point to the graph again
+        if fields[0] == "S" and len(fields) == 9:
+            vehicle, start_age, end_age, samples, min_speed, max_speed, mean_speed, over_ms = fields[1:]
+            ingest_summary(vehicle, now - timedelta(milliseconds=int(start_age)),
+                           now - timedelta(milliseconds=int(end_age)), int(samples), int(min_speed),
+                           int(max_speed), int(mean_speed), int(over_ms))
+            ingested += 1
+            continue
+
+        events = None
+        if fields[0] == "E" and len(fields) == 7:
+            events = int(fields[6])
+            fields = fields[1:6]
+
+        if len(fields) != 5:
+            return f"Error: Bad sample line '{line}'.", 400
+
+        vehicle, sender_ms, age_ms, lights, speed = fields
+        lights = int(lights)
+
+        # same sample already ingested (the devkitV1 resends a batch if it didn't get our response)
+        if (vehicle, sender_ms) in recent_samples:
+            continue
+        recent_samples.append((vehicle, sender_ms))
+
+        # only pass on dash lights that actually changed so notifications aren't repeated for every sample
+        states = {key: "ON" if lights & (1 << bit) else "OFF" for bit, key in enumerate(light_bits)}
+        dash_lights = vehicle_state(vehicle)["dash_lights"]
+        changed = {key: value for key, value in states.items() if dash_lights[key] != value}
+
+        # events say when the speed limit was crossed, anything else keeps the speeding state it had
+        speeding = None
+        if events is not None:
+            speeding = vehicle_state(vehicle)["notified"]
+            if events & EVENT_SPEEDING:
+                speeding = True
+            elif events & EVENT_SPEED_OK:
+                speeding = False
+
+        ingest_sample(vehicle, now - timedelta(milliseconds=int(age_ms)), float(speed), changed, speeding)
+        ingested += 1
+
+    return f"{ingested} samples have been successfully updated"
+
+# route for serving dashboard page of one vehicle (?vehicle=<id>, defaults to the one heard from last)
 @app.route("/serve")
 def serve():
-    # generates new speed/time graph and saves it as png
-    save_speed_plot(df)
+    vehicle, state = viewed_vehicle()
+    if state is None:
+        return f"Error: Unknown vehicle '{vehicle}'.", 404
+    dash_lights = state["dash_lights"]
 
     # serves client with HTML page which implements variables for properly correlating each dash light to on/off
     return render_template('content.html',
+                           vehicle=vehicle,
+                           vehicles=sorted(vehicles.keys()),
                            engine_light=dash_lights['engine_light'],
                            tire_light=dash_lights['tire_light'],
                            oil_light=dash_lights['oil_light'],
-                           battery_light=dash_lights['battery_light'])
\ No newline at end of file
+                           battery_light=dash_lights['battery_light'],
+                           summary=state.get("summary"),
+                           plot=plot_file(vehicle),
+                           plot_version=plot_versions.get(vehicle, 0),
+                           plot_points=PLOT_POINTS,
+                           link=link_stats,
+                           notifications=notifier.stats)
+
+# route for the speed graph data of one vehicle, drawn by the dashboard page itself:
+# ?vehicle=<id> (defaults to the one heard from last), &points=<n> at most this many points (default PLOT_POINTS).
+# Covers everything still kept (older parts come from the minute/hour averages), cut down to the asked number of
+# points, so the answer is the same size however long the server has been running.
+# seq is where the vehicle's /live feed was at the time, with the dash lights and summary as they were then, so
+# a dashboard continuing the feed from there (?since=<seq>) misses nothing and gets nothing twice
+@app.route("/speed.json")
+def speed_points():
+    vehicle = request.args.get("vehicle", default=last_vehicle or DEFAULT_VEHICLE)
+    points = min(max(request.args.get("points", default=PLOT_POINTS, type=int), 1), PLOT_POINTS_MAX)
+
+    times, means, mins, maxs = [], [], [], []
+    version = 0
+    with series_lock:
+        seq = live_feeds[vehicle].seq if vehicle in live_feeds else 0
+        if vehicle in speed_series:
+            version = len(speed_series[vehicle])
+            times, means, mins, maxs = decimate(speed_series[vehicle].query(), points)
+
+    # read after seq: lights and summaries change before they're published, so a change this misses is still
+    # coming on the feed
+    state = vehicles.get(vehicle, new_vehicle_state())
+    summary = state.get("summary")
+    if summary is not None:
+        summary = {key: value for key, value in summary.items() if key not in ("start", "end")}
+
+    return jsonify(vehicle=vehicle,
+                   version=version,
+                   seq=seq,
+                   lights=dict(state["dash_lights"]),
+                   summary=summary,
+                   times=[round(t * 1000) for t in times],
+                   speeds=[round(v, 1) for v in means],
+                   mins=[round(v, 1) for v in mins],
+                   maxs=[round(v, 1) for v in maxs])
+
+# route streaming what changes for one vehicle as server-sent events (?vehicle=<id>, defaults to the one heard from
+# last). Each message is a JSON list of {"type": "speed", "t": <ms>, "speed": <mph>}, {"type": "lights",
+# "lights": {<light>: "ON"/"OFF"}} and {"type": "summary", "summary": {...}}. {"type": "gap"} first means the viewer
+# fell behind and speed points are missing (the current lights and summary are still in the message).
+# &since=<seq> continues after the seq /speed.json gave, a browser reconnecting on its own continues after the
+# Last-Event-ID it sends instead. Without either it starts with what's published from now on
+@app.route("/live")
+def live():
+    vehicle, state = viewed_vehicle()
+    if state is None:
+        return f"Error: Unknown vehicle '{vehicle}'.", 404
+    since = request.args.get("since", type=int)
+    if request.headers.get("Last-Event-ID", "").isdigit():
+        since = int(request.headers["Last-Event-ID"])
+    return Response(feed_for(vehicle).stream(since), mimetype="text/event-stream",
+                    headers={"Cache-Control": "no-cache", "X-Accel-Buffering": "no"})
@@ -0,0 +1,183 @@
+# bounded time series store for the speed data of one vehicle, replaces appending to a pandas DataFrame (which
+# copied the whole history on every sample and never gave memory back)
+#
+# Samples go into a preallocated ring of raw points. Every append also feeds coarser tiers (e.g. 1 minute and
+# 1 hour buckets keeping mean/min/max), each its own fixed size ring, so older data is still there at a lower
+# resolution once the raw ring has wrapped. Queries stitch the tiers together, raw points for the newest part and
+# coarser ones further back. Appending is constant time and memory never grows
+from array import array
+from bisect import bisect_left
+
+# (bucket length in seconds, how many points the tier keeps), the first tier is the raw samples
+# raw: the last 3600 samples, minutes: 1 day, hours: 30 days
+DEFAULT_TIERS = [(0, 3600), (60, 24 * 60), (3600, 30 * 24)]
+
+
+# one fixed size ring of (time, mean, min, max) points, oldest first
+class Tier:
+    def __init__(self, bucket_s, capacity):
+        self.bucket_s = bucket_s
+        self.capacity = capacity
+        self.times = array("d", bytes(8 * capacity))
+        self.values = array("f", bytes(4 * capacity))
+        self.mins = array("f", bytes(4 * capacity))
+        self.maxs = array("f", bytes(4 * capacity))
+        self.head = 0  # oldest point
+        self.count = 0
+
+        # bucket still being filled (coarse tiers only)
+        self.open_start = None
+        self.open_sum = 0.0
+        self.open_count = 0
+        self.open_min = 0.0
+        self.open_max = 0.0
+
+    def _push(self, t, value, low, high):
+        if self.count == self.capacity:
+            # full, the oldest point makes room (it's still in the coarser tiers)
+            i = self.head
+            self.head = (self.head + 1) % self.capacity
+        else:
+            i = (self.head + self.count) % self.capacity
+            self.count += 1
+        self.times[i] = t
+        self.values[i] = value
+        self.mins[i] = low
+        self.maxs[i] = high
+
+    def add(self, t, value):
+        if self.bucket_s == 0:
+            self._push(t, value, value, value)
+            return
+
+        start = t - t % self.bucket_s
+        if self.open_start is not None and start != self.open_start:
+            self.close()
+        if self.open_start is None:
+            self.open_start = start
+            self.open_sum = 0.0
+            self.open_count = 0
+            self.open_min = value
+            self.open_max = value
+        self.open_sum += value
+        self.open_count += 1
+        self.open_min = min(self.open_min, value)
+        self.open_max = max(self.open_max, value)
+
+    # moves the bucket being filled into the ring
+    def close(self):
+        if self.open_start is not None:
+            self._push(self.open_start, self.open_sum / self.open_count, self.open_min, self.open_max)
+            self.open_start = None
+
+    def time_at(self, i):
+        return self.times[(self.head + i) % self.capacity]
+
+    # time of the oldest point this tier can answer for
+    def oldest(self):
+        if self.count > 0:
+            return self.time_at(0)
+        return self.open_start
+
+    # first logical index with a time >= t (binary search, points are in time order)
+    def bisect(self, t):
+        low, high = 0, self.count
+        while low < high:
+            mid = (low + high) // 2
+            if self.time_at(mid) < t:
+                low = mid + 1
+            else:
+                high = mid
+        return low
+
+    # (times, means, mins, maxs) lists of the points in [start, end], including the open bucket
+    # (a bucket that starts before start but reaches into the range counts as in it)
+    def range(self, start, end):
+        start -= self.bucket_s
+        first = self.bisect(start)
+        last = self.bisect(end + 1e-9) if end is not None else self.count
+        result = ([], [], [], [])
+        for i in range(first, last):
+            j = (self.head + i) % self.capacity
+            result[0].append(self.times[j])
+            result[1].append(self.values[j])
+            result[2].append(self.mins[j])
+            result[3].append(self.maxs[j])
+        if self.open_start is not None and self.open_start >= start and (end is None or self.open_start <= end):
+            result[0].append(self.open_start)
+            result[1].append(self.open_sum / self.open_count)
+            result[2].append(self.open_min)
+            result[3].append(self.open_max)
+        return result
+
+
+class TimeSeries:
+    def __init__(self, tiers=DEFAULT_TIERS):
+        if tiers[0][0] != 0:
+            raise ValueError("the first tier has to keep raw samples (bucket length 0)")
+        self.tiers = [Tier(bucket_s, capacity) for bucket_s, capacity in tiers]
+        self.last_t = None
+        self.appended = 0
+
+    # adds one value at time t (POSIX seconds). Times are kept in order for the range search, so a sample that
+    # arrives a little out of order (e.g. from two batches overlapping) is moved up to the newest time
+    def append(self, t, value):
+        if self.last_t is not None and t < self.last_t:
+            t = self.last_t
+        self.last_t = t
+        self.appended += 1
+        for tier in self.tiers:
+            tier.add(t, value)
+
+    def __len__(self):
+        return self.appended
+
+    # points between start and end (POSIX seconds, None = everything kept), each part of the range from the finest
+    # tier that still has it: the newest from the raw samples, what's older than those from the minute buckets
+    # and so on. Returns (times, means, mins, maxs) lists in time order, raw points have min = max = mean
+    def query(self, start=None, end=None):
+        if start is None:
+            start = float("-inf")
+
+        # finest first, each coarser tier only fills in what's older than the finer ones reach back to
+        parts = []
+        before = None
+        for tier in self.tiers:
+            part = tier.range(start, end)
+            if before is not None:
+                # a bucket that started before the finer tier's oldest point still counts, it's older data
+                # averaged together with some the finer tier has too
+                keep = bisect_left(part[0], before)
+                part = tuple(values[:keep] for values in part)
+            parts.append(part)
+
+            # a tier that never wrapped still has everything it was given
+            oldest = tier.oldest()
+            if tier.count < tier.capacity or oldest is None or oldest <= start:
+                break
+            before = oldest if before is None else min(before, oldest)
+
+        result = ([], [], [], [])
+        for part in reversed(parts):
+            for values, more in zip(result, part):
+                values.extend(more)
+        return result
+
+
+# cuts (times, means, mins, maxs) down to at most max_points buckets for drawing, each keeping the time of its
+# first point, the mean of its means and the lowest/highest values so short spikes still show
+def decimate(points, max_points):
+    times, means, mins, maxs = points
+    n = len(times)
+    if n <= max_points:
+        return points
+
+    result = ([], [], [], [])
+    for b in range(max_points):
+        first = b * n // max_points
+        last = (b + 1) * n // max_points
+        result[0].append(times[first])
+        result[1].append(sum(means[first:last]) / (last - first))
+        result[2].append(min(mins[first:last]))
+        result[3].append(max(maxs[first:last]))
+    return result
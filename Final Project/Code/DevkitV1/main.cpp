@@ -1,105 +1,190 @@
-// devkitV1 - receives simulated data from TTGO and sends to cloud
+// devkitV1 - receives simulated data from any number of TTGOs (one per vehicle) and sends to cloud
 
 // libs to setup devkitV1 as ESP-NOW receiver
 #include <esp_now.h>
 #include <WiFi.h>
 
 // used for conneting to wifi and sending HTTP requests to cloud
-#include <HttpClient.h>
+#include <Uplink.h>  // keep-alive connection to the server (shared with Lab 3)
+#include <SampleBatch.h> // buffers samples so they go up as one request
+#include <SpscQueue.h>   // hands frames from the ESP-NOW callback to loop() without locks
+#include <VehicleFrame.h> // frame layout shared with the TTGO
+#include <ReliableLink.h> // sequence number checks for retransmitted frames
+#include <PeerTable.h>    // per-vehicle state keyed by sender MAC
+#include <SpeedAggregator.h> // rolling speed statistics per vehicle
 #include <secrets.h> // contains WiFi SSID and PASS
 
 // connecting to cloud server
 IPAddress serverAddr = IPAddress(128,85,32,135); // server IP is 128.85.32.135
 uint16_t serverPort = 8080;
 
-// segment of URL following the domain (http://128.85.32.135:8080 in this case)
-String parameters = "";
+// segment of URL following the domain (http://128.85.32.135:8080 in this case) that takes batches of samples,
+// link quality counters go along in the query string so they show up on the dashboard
+char batchPath[160];
 
 // Number of milliseconds to wait without receiving any data before we give up
 const int kNetworkTimeout = 30*1000;
-// Number of milliseconds to wait if no data is available before trying again
-const int kNetworkDelay = 1000;
-
-// Structure example to receive data
-// Must match the sender structure
-typedef struct receive_struct {
-  int engineLight = LOW;
-  int tireLight = LOW;
-  int oilLight = LOW;
-  // int batteryLight = LOW;
-  int speed = 0;
-} receive_struct;
-
-// Create a struct_message for handling data received from sender ESP32
-receive_struct receivedData;
-
-String prev_engine_light = "OFF";
-String engine_light = "OFF";
-
-String prev_tire_light = "OFF";
-String tire_light = "OFF";
-
-String prev_oil_light = "OFF";
-String oil_light = "OFF";
-
-
-// Setting up state management to switch between ESP-NOW and WiFi Station (module can only work with one at a time)
-// This works in this case since we only send data at 5 second intervals, allowing enough time to avoid data loss
+// Number of milliseconds to wait after a failed flush before trying the batch again
+const int kRetryDelay = 5000;
+unsigned long lastFailedFlush = 0;
+// Number of milliseconds to give a reconnect before calling WiFi.begin again
+const int kReconnectTimeout = 10*1000;
+unsigned long reconnectStarted = 0;
+
+// one connection to the server that stays open between samples (only reconnects if it drops)
+WiFiClient client;
+Uplink uplink(client, serverAddr, serverPort, "Azure Server", kNetworkTimeout);
+
+// when to send buffered samples: every 16 samples (from all vehicles together), once the oldest is 30 s old,
+// or right away if a dash light changed. Lower these for a more live dashboard, raise them for fewer uplinks
+const FlushPolicy flushPolicy = { 16, 30*1000, true };
+SampleBatch batch(flushPolicy);
+
+// 1 = keep rolling speed statistics per vehicle and only upload a summary every kSummaryInterval plus events
+// (dash light changes, crossing the speed limit) the moment they happen
+// 0 = forward every sample like before (build with -DEDGE_AGGREGATION=0 to compare uplink volume)
+#ifndef EDGE_AGGREGATION
+#define EDGE_AGGREGATION 1
+#endif
+
+// the cloud alerts on speeding, the gateway now decides when that happens (same 70 mph the server used)
+const uint8_t kSpeedLimit = 70;
+// how often each vehicle's min/max/mean/time over the limit go up, longer = less uplink but a staler graph
+const unsigned long kSummaryInterval = 30*1000;
+unsigned long lastSummary = 0;
+
+// samples copied out of the batch and the POST body built from them and the summaries (kept until the server answers)
+// sentFrom is where in the batch they were when they went out, so the right ones get removed even if new frames
+// pushed some of them out meanwhile
+Sample outgoing[SAMPLE_BATCH_CAPACITY];
+uint8_t sentCount = 0;
+unsigned long sentFrom = 0;
+char batchBody[SAMPLE_BATCH_CAPACITY * SAMPLE_LINE_MAX + PEER_TABLE_CAPACITY * SUMMARY_LINE_MAX];
+
+// frames thrown away because of a wrong length/version/crc (indexed by FrameError)
+unsigned long rejectedFrames[FRAME_BAD_CRC + 1] = {0};
+
+// one entry per TTGO, each with its own sequence number checks (a TTGO resends when it misses our ack)
+// and the last dash lights it reported
+PeerTable vehicles;
+
+// raw ESP-NOW frame as it came in, the callback only copies these into the queue
+#define MAX_FRAME_LEN 32
+typedef struct raw_frame {
+  uint32_t receivedMs;          // millis() when the frame arrived
+  uint8_t mac[6];               // sender MAC
+  uint8_t len;
+  uint8_t data[MAX_FRAME_LEN];
+} raw_frame;
+
+// OnDataRecv runs in the WiFi task, so frames are pushed here and all the parsing/formatting happens in loop()
+// TTGOs send on change with a 10 s heartbeat, so 64 frames covers a burst from the whole fleet during an upload
+SpscQueue<raw_frame, 64> frameQueue;
+volatile bool frameTooLong = false;
+
+// Setting up state management for the gateway. The module stays associated to the AP the whole time and
+// ESP-NOW keeps listening on the AP's channel, so receiving from the TTGO and uploading to the cloud overlap
+// (no more tearing down ESP-NOW and redoing WiFi.begin + DHCP for every sample)
 enum State {
   IDLE,             // waits to receive data over ESP-NOW
-  CONNECT_WIFI,     // establishes wifi connection
-  SEND_HTTP,        // sends data to cloud
-  DISCONNECT_WIFI,  // stops WiFi
-  START_ESPNOW      // begins to listen on ESP-NOW
+  SEND_HTTP,        // sends buffered samples to cloud as one batch
+  WAIT_RESPONSE,    // checks on the server's answer each loop without blocking
+  RECONNECT_WIFI    // only used if the AP connection drops, ESP-NOW is left running and frames keep being queued
 };
 
-volatile bool dataReceived = false;
 State currentState = IDLE;
 
-// callback function that will be executed when data is received
+void beginWiFi();
+void connectWiFi();
+void printWiFi();
+
+// true if any vehicle has a closed statistics window that hasn't been uploaded yet
+bool summariesPending() {
+  for (uint8_t i = 0; i < vehicles.size(); i++) {
+    if (vehicles.at(i).speed.pending()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// callback function that will be executed when data is received (runs in the WiFi task, keep it short)
 void OnDataRecv(const uint8_t * mac, const uint8_t *incomingData, int len) {
-  memcpy(&receivedData, incomingData, sizeof(receivedData));
+  if (len > MAX_FRAME_LEN) {
+    frameTooLong = true;
+    return;
+  }
 
-  engine_light = (receivedData.engineLight == LOW) ? "OFF" : "ON";
-  tire_light = (receivedData.tireLight == LOW) ? "OFF" : "ON";
-  oil_light = (receivedData.oilLight == LOW) ? "OFF" : "ON";
-  // battery_light = (receivedData.batteryLight == LOW) ? "OFF" : "ON";
+  raw_frame frame;
+  frame.receivedMs = millis();
+  memcpy(frame.mac, mac, sizeof(frame.mac));
+  frame.len = len;
+  memcpy(frame.data, incomingData, len);
+  frameQueue.push(frame);
+} 
 
-  parameters = "/?"; 
+// turns a queued frame into a sample for the batch (only called from loop())
+void handleFrame(const raw_frame &frame) {
+  // make sure it's a frame we understand before using any of it
+  vehicle_frame receivedData;
+  FrameError err = openFrame(frame.data, frame.len, receivedData);
+  if (err != FRAME_OK) {
+    rejectedFrames[err]++;
+    Serial.printf("Rejected frame (error %d, %u bytes)\n", err, frame.len);
+    return;
+  }
 
-  // only send to cloud if value has changed since lights don't change often
-  if (engine_light != prev_engine_light) {
-    parameters += "engine_light=" + engine_light + "&";
+  // which vehicle it's from decides which sequence numbers/lights it's compared against
+  Peer *vehicle = vehicles.find(frame.mac, frame.receivedMs);
+  if (vehicle == NULL) {
+    return;
+  }
+  if (vehicle->link.accept(receivedData.sequence, receivedData.timestamp) != LINK_NEW) {
+    return;
   }
-  if (tire_light != prev_tire_light) {
-    parameters += "tire_light=" + tire_light + "&";
+  bool lightChange = receivedData.lights != vehicle->lights;
+  vehicle->lights = receivedData.lights;
+
+  Sample sample;
+  memcpy(sample.vehicle, frame.mac, sizeof(sample.vehicle));
+  sample.senderMs = receivedData.timestamp;
+  sample.receivedMs = frame.receivedMs;
+  sample.lights = receivedData.lights; // passed on as is, the server knows which bit is which light
+  sample.speed = receivedData.speed;
+
+#if EDGE_AGGREGATION
+  // every reading goes into the statistics, only the ones where something happened are kept as they are
+  SpeedEvent speedEvent = vehicle->speed.add(sample.speed, frame.receivedMs, kSpeedLimit);
+  if (lightChange) {
+    sample.events |= SAMPLE_EVENT_LIGHTS;
   }
-  if (oil_light != prev_oil_light) {
-    parameters += "oil_light=" + oil_light + "&";
+  if (speedEvent == SPEED_EVENT_OVER) {
+    sample.events |= SAMPLE_EVENT_SPEEDING;
+  } else if (speedEvent == SPEED_EVENT_UNDER) {
+    sample.events |= SAMPLE_EVENT_SPEED_OK;
   }
-  // if (battery_light != prev_battery_light) {
-  //   parameters += "battery_light=" + battery_light + "&";
-  // }
-
-  prev_engine_light = engine_light;
-  prev_tire_light = tire_light;
-  prev_oil_light = oil_light;
-  // prev_battery_light = battery_light;
-
-  // speed value will constantly be sent to cloud
-  parameters += "speed=" + String(receivedData.speed);
-  dataReceived = true;
-  Serial.println("Received");
-} 
+
+  // events flush right away, so alerts reach the cloud as quickly as when every sample went up
+  if (sample.events != 0) {
+    batch.push(sample, true);
+  }
+#else
+  // only buffer it here, the server works out which dash lights changed
+  batch.push(sample, lightChange);
+#endif
+}
 
 
 void setup() {
   // Initialize Serial Monitor
   Serial.begin(115200);
   
-  // Set device as a Wi-Fi Station
+  // Set device as a Wi-Fi Station and join the AP once, ESP-NOW will then run on the AP's channel
   WiFi.mode(WIFI_STA);
-  // WiFi.mode(WIFI_AP_STA);
+  connectWiFi();
+
+  // keep the radio awake, otherwise modem sleep makes us miss ESP-NOW frames between beacons
+  WiFi.setSleep(false);
 
   // Init ESP-NOW
   if (esp_now_init() != ESP_OK) {
@@ -113,127 +198,172 @@ void setup() {
 }
 
 void loop() {
+  // move everything the callback queued into the batch before deciding what to do
+  raw_frame frame;
+  while (frameQueue.pop(frame)) {
+    handleFrame(frame);
+  }
+  if (frameTooLong) {
+    frameTooLong = false;
+    Serial.println("Ignored frame that was too long");
+  }
+
   switch (currentState) {
-    // simply waits until it receives data from TTGO
+    // buffers data from TTGO until the flush policy says to send it
     case IDLE:
-      if (dataReceived) {
-        // switch to wifi mode to send the received data
-        dataReceived = false;
-        currentState = CONNECT_WIFI;
-        Serial.println("Data received, preparing to connect Wi-Fi...");
-        esp_now_deinit(); // stop ESP-NOW to allow WiFi mode
-        delay(10);
+      if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("Wi-Fi lost");
+        beginWiFi();
+        currentState = RECONNECT_WIFI;
       }
-      break;
-    
-    // reestablishes a wifi conenction based on (currently) hardcoded credentials
-    case CONNECT_WIFI:
-      WiFi.mode(WIFI_STA);
-      WiFi.begin(WIFI_SSID, WIFI_PASS);
-      Serial.print("Connecting to Wi-Fi");
-      
-
-      while (WiFi.status() != WL_CONNECTED) {
-        delay(250);
-        Serial.print(".");
-      }
-
-      if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("\nWi-Fi Connected!");
-        // once connection established, prepare to send the data to cloud
-        currentState = SEND_HTTP;
+      else {
+#if EDGE_AGGREGATION
+        // ends every vehicle's window on the summary cadence, only ever here so nothing closes while a batch
+        // (and the summaries in it) is waiting for the server's answer
+        if (millis() - lastSummary >= kSummaryInterval) {
+          lastSummary = millis();
+          for (uint8_t i = 0; i < vehicles.size(); i++) {
+            vehicles.at(i).speed.close();
+          }
+        }
+        bool flush = batch.shouldFlush(millis()) || summariesPending();
+#else
+        bool flush = batch.shouldFlush(millis());
+#endif
+
+        // WiFi is already up, go straight to sending the buffered data (backing off if the last try failed)
+        if (flush && (lastFailedFlush == 0 || millis() - lastFailedFlush >= kRetryDelay)) {
+          currentState = SEND_HTTP;
+        }
       }
       break;
 
     // makes a request to cloud server (flask) to send data using HTTP
     case SEND_HTTP:
       {
-        // HTTP code taken from Lab 3
-        int err=0;
-        
-        WiFiClient c;
-        HttpClient http(c);
-
-        err = http.get(serverAddr, "Azure Server", serverPort, parameters.c_str());
-        if (err == 0)
+        // copy the samples out, frames that come in while we send are queued and added on the next pass
+        uint8_t count = batch.peek(outgoing, SAMPLE_BATCH_CAPACITY);
+        unsigned long from = batch.position();
+
+        unsigned long now = millis();
+        size_t bodyLen = formatBatch(outgoing, count, now, batchBody, sizeof(batchBody));
+
+#if EDGE_AGGREGATION
+        // the body has room for a summary from every vehicle after a full batch
+        for (uint8_t i = 0; i < vehicles.size(); i++) {
+          const Peer &vehicle = vehicles.at(i);
+          if (vehicle.speed.pending()) {
+            bodyLen += formatSummary(vehicle.id, vehicle.speed.closed(), now, batchBody + bodyLen,
+                                     sizeof(batchBody) - bodyLen);
+          }
+        }
+#endif
+
+        // fleet-wide link counters, per vehicle ones are on the serial monitor
+        LinkReceiverStats link = vehicles.totals();
+        snprintf(batchPath, sizeof(batchPath),
+                 "/batch?received=%lu&duplicates=%lu&out_of_order=%lu&lost=%lu&vehicles=%u",
+                 link.received, link.duplicates, link.outOfOrder, link.lost, vehicles.size());
+#if EDGE_AGGREGATION
+        // the counters are statistics too, they only go along with the summaries and not with every event
+        if (!summariesPending()) {
+          snprintf(batchPath, sizeof(batchPath), "/batch");
+        }
+#endif
+
+        // reuses the open connection rather than a new WiFiClient/HttpClient per sample
+        if (uplink.post(batchPath, "text/csv", batchBody, bodyLen)) {
+          sentCount = count;
+          sentFrom = from;
+          currentState = WAIT_RESPONSE;
+        }
+        else
         {
-          Serial.println("\nstartedRequest ok");
-
-          err = http.responseStatusCode();
-          if (err >= 0)
-          {
-            Serial.println("\nResponse status: " + String(err));
-
-            err = http.skipResponseHeaders();
-            if (err >= 0)
-            {
-              int bodyLen = http.contentLength();
-              Serial.println("HTTP Response Body:");
-            
-              // Now we've got to the body, so we can print it out
-              unsigned long timeoutStart = millis();
-              char c;
-              // Whilst we haven't timed out & haven't reached the end of the body
-              while ( (http.connected() || http.available()) && ((millis() - timeoutStart) < kNetworkTimeout) )
-              {
-                  if (http.available())
-                  {
-                      c = http.read();
-                      // Print out this character
-                      Serial.print(c);
-                    
-                      bodyLen--;
-                      // We read something, reset the timeout counter
-                      timeoutStart = millis();
-                  }
-                  else
-                  {
-                      // We haven't got any data, so let's pause to allow some to arrive
-                      delay(kNetworkDelay);
-                  }
-              }
-
-              Serial.println();
-            }
-            else
-            {
-              Serial.println("Failed to skip response headers: " + err);
-            }
+          Serial.println("Connect failed");
+          lastFailedFlush = millis();
+          currentState = IDLE;
+        }
+      }
+      break;
+
+    // reads whatever part of the response has arrived, frames keep getting queued/batched in the meantime
+    case WAIT_RESPONSE:
+      {
+        int status = uplink.poll();
+        if (status == UPLINK_WAITING) {
+          break;
+        }
+
+        if (status >= 200 && status < 300)
+        {
+          Serial.println("\nResponse status: " + String(status));
+          Serial.println("HTTP Response Body:");
+          Serial.println(uplink.body());
+
+          // only drop the samples once the server has them, otherwise they're retried on the next flush
+          lastFailedFlush = 0;
+          batch.consume(sentFrom, sentCount);
+          for (uint8_t i = 0; i < vehicles.size(); i++) {
+            vehicles.at(i).speed.uploaded();
           }
-          else
-          {    
-            Serial.println("Getting response failed: " + err);
+
+          // time from the oldest sample arriving over ESP-NOW to the upload finishing
+          if (sentCount > 0) {
+            Serial.printf("Sent %u samples, oldest waited %lu ms\n", sentCount, millis() - outgoing[0].receivedMs);
           }
         }
         else
         {
-          Serial.println("Connect failed: " + err);
+          Serial.println("Request failed: " + String(status));
+          lastFailedFlush = millis();
         }
-        http.stop();
-        currentState = DISCONNECT_WIFI; // once data has been sent, stop the wifi to begin listening over ESP-NOW again
+        uplink.printStats(Serial);
+        for (uint8_t i = 0; i < vehicles.size(); i++) {
+          Serial.printf("%s ", vehicles.at(i).id);
+          vehicles.at(i).link.printStats(Serial);
+        }
+        Serial.printf("Frame queue: %u waiting, %lu dropped / rejected: %lu length, %lu version, %lu crc, "
+                      "%lu table full (%lu vehicles evicted)\n", (unsigned) frameQueue.size(), frameQueue.dropped(),
+                      rejectedFrames[FRAME_BAD_LENGTH], rejectedFrames[FRAME_BAD_VERSION],
+                      rejectedFrames[FRAME_BAD_CRC], vehicles.rejected(), vehicles.evicted());
+
+        currentState = IDLE; // ESP-NOW never stopped listening, so just go back to waiting
       }
       break;
 
-    // simply stops WiFi
-    case DISCONNECT_WIFI:
-      WiFi.disconnect(true);
-      Serial.println("Wi-Fi disconnected");
-      delay(100);
-      // reenables ESP-NOW for next data sent by TTGO
-      currentState = START_ESPNOW;
+    // AP connection dropped, checks each loop whether it's back without waiting on it, so the frame queue keeps
+    // being drained into the batch (ESP-NOW is left initialized and follows the AP's channel)
+    case RECONNECT_WIFI:
+      if (WiFi.status() == WL_CONNECTED) {
+        printWiFi();
+        currentState = IDLE;
+      }
+      else if (millis() - reconnectStarted >= kReconnectTimeout) {
+        beginWiFi();
+      }
       break;
+  }
+}
 
-    // starts ESP-NOW mode 
-    case START_ESPNOW:
-      WiFi.mode(WIFI_STA);
-      delay(50);
-      if (esp_now_init() != ESP_OK) {
-        Serial.println("Failed to restart ESP-NOW!");
-      }
+// starts joining the AP based on (currently) hardcoded credentials, returns straight away
+void beginWiFi() {
+  WiFi.begin(WIFI_SSID, WIFI_PASS);
+  reconnectStarted = millis();
+  Serial.print("Connecting to Wi-Fi");
+}
 
-      // function needs to be assigned every time ESP-NOW is initialized
-      esp_now_register_recv_cb(OnDataRecv);
-      currentState = IDLE; // swaps to stay idle (listening on ESP-NOW)
-      break;
+// the TTGO has to send on the channel printed here
+void printWiFi() {
+  Serial.println("\nWi-Fi Connected!");
+  Serial.println("ESP-NOW channel: " + String(WiFi.channel()));
+}
+
+// joins the AP and waits for it, only at boot before ESP-NOW is listening (there's nothing to drain yet)
+void connectWiFi() {
+  beginWiFi();
+  while (WiFi.status() != WL_CONNECTED) {
+    delay(250);
+    Serial.print(".");
   }
-}
\ No newline at end of file
+  printWiFi();
+}
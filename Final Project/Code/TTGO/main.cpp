@@ -2,99 +2,108 @@
 
 #include <esp_now.h>
 #include <WiFi.h>
+#include <esp_wifi.h>
+#include <secrets.h> // contains WiFi SSID (only used to find the channel the devkitV1 is listening on)
+#include <VehicleFrame.h> // frame layout shared with the devkitV1
+#include <ReliableLink.h> // retransmits frames that weren't delivered
+#include <SendScheduler.h> // sends on changes instead of a fixed period
+#include <ButtonEvents.h> // button presses from GPIO interrupts
+#include <SpeedSampler.h> // potentiometer read continuously over DMA and filtered
 
 // configures mac address (taken from devkitV1 - our receiver ESP32)
 uint8_t broadcastAddress[] = {0xEC, 0xE3, 0x34, 0x79, 0x8B, 0x74};
 // ec:e3:34:79:8b:74
 
-// Structure to send data to receiver ESP32
-// Must match the receiver structure
-typedef struct send_struct {
-  int engineLight = LOW;
-  int tireLight = LOW;
-  int oilLight = LOW;
-  // int batteryLight = LOW;
-  int speed = 0;
-} send_struct;
-
-// Create a struct for sending data over ESP-NOW
-send_struct sendData;
+// Create a frame for sending data over ESP-NOW (all lights off to start)
+vehicle_frame sendData = {};
 
 // init peer to later get status info from receiver ESP32
 esp_now_peer_info_t peerInfo;
 
-// callback when data is sent (delivery confirmation)
+// resends a frame (same sequence number) up to 5 times with 10-160 ms backoff if delivery fails
+LinkSender espNowLink(broadcastAddress);
+
+// callback when data is sent (delivery confirmation), runs in the WiFi task so loop() handles the retry
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
-  Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+  espNowLink.onSendStatus(status == ESP_NOW_SEND_SUCCESS);
 }
 
-unsigned long lastDataSent = 0; // time stamp for last data send event
-int sendThreshold = 5000; // send data to receiver ESP32 every 5 seconds
+// send right away when a light changes or speed moves more than 2 mph, at most every 100 ms,
+// and otherwise a heartbeat every 10 seconds
+SendPolicy sendPolicy = {10000, 100, 2};
+SendScheduler scheduler(sendPolicy);
 
-// struct for handling all data related to dashboard lights
+// everything about one dashboard light, the table below is all the code needs (name/pins live in flash)
 typedef struct dash_light {
-  String description;       // data later sent to cloud
+  const char *description;  // name the cloud knows it by
   gpio_num_t button_pin;    // pin config for button
   gpio_num_t LED_pin;       // pin config for LED
-  int lightState = LOW;     // helps for toggling ON/OFF state
-  int prevBtnState = HIGH;  // last 3 help confirm button presses with debouncing
-  int currBtnState;
-  unsigned long lastUpdate = 0;
+  uint8_t frameBit;         // LIGHT_* bit in the frame, sendData.lights holds the ON/OFF state of every light
 } dash_light;
 
-dash_light engine;  // yellow button/LED
-dash_light tire;    // blue button/LED
-dash_light oil;     // red button/LED
-// dash_light battery; // green button/LED
+// adding a light is one more line here (plus its bit in VehicleFrame.h if it's a new one)
+constexpr dash_light dashLights[] = {
+  {"engine_light", GPIO_NUM_32, GPIO_NUM_22, LIGHT_ENGINE},   // yellow button/LED
+  {"tire_light",   GPIO_NUM_12, GPIO_NUM_2,  LIGHT_TIRE},     // blue button/LED
+  {"oil_light",    GPIO_NUM_13, GPIO_NUM_26, LIGHT_OIL},      // red button/LED
+  // {"battery_light", GPIO_NUM_23, GPIO_NUM_15, LIGHT_BATTERY}, // green button/LED
+};
+
+constexpr size_t dashLightCount = sizeof(dashLights) / sizeof(dashLights[0]);
+static_assert(dashLightCount <= BUTTON_EVENTS_MAX_BUTTONS, "more dash lights than ButtonEvents can track");
+
+// button edges interrupt us and a 20 ms timer debounces them, so loop() doesn't have to poll the pins
+// (button numbers it hands back are indexes into dashLights, they're added in the same order)
+ButtonEvents buttons;
+
+// how long loop() sleeps waiting for a button when nothing else is going on (speed is checked this often)
+#define IDLE_WAIT_MS 50
+
+#define speedPin GPIO_NUM_36 // GPIO 36 is an ADC pin to read analog data
+#define speedChannel ADC1_CHANNEL_0 // GPIO 36 is channel 0 of ADC1
 
-bool buttonPressed(dash_light &light);
-int pressThreshold = 1000; // 1 second cooldown before allowing another button press
+// keeps the newest filtered speed reading ready for loop()
+SpeedSampler speedSampler;
 
-#define speedPin GPIO_NUM_36 // GPIO 4 is an ADC pin to read analog data
+int32_t getWiFiChannel(const char *ssid);
 
 void setup() {
   Serial.begin(115200);
 
-  // ******** SETTING UP INFO/PIN CONFIG ********
-  engine.description = "engine_light";
-  engine.button_pin = GPIO_NUM_32;
-  engine.LED_pin = GPIO_NUM_22;
-
-  tire.description = "tire_light";
-  tire.button_pin = GPIO_NUM_12;
-  tire.LED_pin = GPIO_NUM_2;
-
-  oil.description = "oil_light";
-  oil.button_pin = GPIO_NUM_13;
-  oil.LED_pin = GPIO_NUM_26; 
-
-  // battery.description = "battery_light";
-  // battery.button_pin = GPIO_NUM_23;
-  // battery.LED_pin = GPIO_NUM_15;
-
-  // sets all buttons as inputs (HIGH = UNPRESSED / LOW = PRESSED)
-  pinMode(engine.button_pin, INPUT_PULLUP);
-  pinMode(tire.button_pin, INPUT_PULLUP);
-  pinMode(oil.button_pin, INPUT_PULLUP);
-  // pinMode(battery.button_pin, INPUT_PULLUP);
-
-  // sets all LEDs as output
-  pinMode(engine.LED_pin, OUTPUT);
-  pinMode(tire.LED_pin, OUTPUT);
-  pinMode(oil.LED_pin, OUTPUT);
-  // pinMode(battery.LED_pin, OUTPUT);
-  // ******** FINISHED SETTING UP INFO/PIN CONFIG ********
-
-  // ensures all LEDs are off when system starts
-  digitalWrite(engine.LED_pin, LOW);
-  digitalWrite(tire.LED_pin, LOW);
-  digitalWrite(oil.LED_pin, LOW);
-  // digitalWrite(battery.LED_pin, LOW);
+  // ******** SETTING UP PIN CONFIG ********
+  for (const dash_light &light : dashLights) {
+    // sets the button as input (HIGH = UNPRESSED / LOW = PRESSED) and attaches its interrupt
+    buttons.add(light.button_pin);
+
+    // sets the LED as output and ensures it's off when system starts
+    pinMode(light.LED_pin, OUTPUT);
+    digitalWrite(light.LED_pin, LOW);
+  }
+  if (!buttons.begin()) {
+    Serial.println("Error setting up button interrupts");
+  }
+  // ******** FINISHED SETTING UP PIN CONFIG ********
+
+  // starts streaming the potentiometer, a new filtered value comes in every ~13 ms
+  if (!speedSampler.begin(speedChannel)) {
+    Serial.println("Error starting speed sampling");
+  }
 
   // ******** SETTING UP ESP-NOW - Taken from Arduino Docs: https://docs.arduino.cc/tutorials/nano-esp32/esp-now ********
   // Set device as a Wi-Fi Station (used for getting channel for ESP-NOW)
   WiFi.mode(WIFI_STA);
 
+  // devkitV1 stays connected to the AP, so ESP-NOW frames have to go out on the AP's channel
+  int32_t channel = getWiFiChannel(WIFI_SSID);
+  if (channel > 0) {
+    esp_wifi_set_promiscuous(true);
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    esp_wifi_set_promiscuous(false);
+    Serial.println("ESP-NOW channel: " + String(channel));
+  } else {
+    Serial.println("AP not found, staying on default channel");
+  }
+
   // Init ESP-NOW
   if (esp_now_init() != ESP_OK) {
     Serial.println("Error initializing ESP-NOW");
@@ -119,58 +128,55 @@ void setup() {
 
 
 void loop() {
-  // if button correlating to engine dash light is pressed
-  if (buttonPressed(engine)) {
-    // toggle dash light state and update LED for easy visualization
-    engine.lightState = !engine.lightState;
-    digitalWrite(engine.LED_pin, engine.lightState);
-
-    // include change in data being sent to receiver ESP32
-    sendData.engineLight = engine.lightState;
-  }
-
-  if (buttonPressed(tire)) {
-    tire.lightState = !tire.lightState;
-    digitalWrite(tire.LED_pin, tire.lightState);
-
-    sendData.tireLight = tire.lightState;
+  // handles every button press queued since the last pass
+  ButtonEvent press;
+  while (buttons.pop(press)) {
+    const dash_light &light = dashLights[press.button];
+
+    // toggle dash light state right in the data being sent to receiver ESP32
+    sendData.lights ^= light.frameBit;
+
+    // update LED for easy visualization
+    bool on = (sendData.lights & light.frameBit) != 0;
+    digitalWrite(light.LED_pin, on ? HIGH : LOW);
+    Serial.printf("%s %s\n", light.description, on ? "ON" : "OFF");
   }
 
-  if (buttonPressed(oil)) {
-    oil.lightState = !oil.lightState;
-    digitalWrite(oil.LED_pin, oil.lightState);
-
-
-    sendData.oilLight = oil.lightState;
+  // speed data will consistently be sent to receiver ESP32 (already averaged/filtered and bound to 0-100 mph)
+  sendData.speed = speedSampler.speed();
+
+  // send data when something changed (or the heartbeat is due)
+  unsigned long now = millis();
+  SendReason reason = scheduler.check(sendData.lights, sendData.speed, now);
+  if (reason != SEND_NONE) {
+    sendData.timestamp = now;
+    sendData.sequence++;
+    sealFrame(sendData); // sets version + crc
+    espNowLink.send((uint8_t *) &sendData, sizeof(sendData));
+    scheduler.sent(reason, sendData.lights, sendData.speed, now);
+
+    if (reason == SEND_HEARTBEAT) {
+      espNowLink.printStats(Serial);
+      scheduler.printStats(Serial);
+      buttons.printStats(Serial);
+    }
   }
 
-  // speed data will consistently be sent to receiver ESP32
-  // Serial.println((int) (analogRead(speedPin) / 4095.0 * 100));
-  sendData.speed = (int) (analogRead(speedPin) / 4095.0 * 100); // bound potentiometer to 0-100 mph
-
-  // send data on a set interval: current threshold set as 5 seconds
-  if (millis() - lastDataSent >= sendThreshold) {
-    lastDataSent = millis();
-    esp_now_send(broadcastAddress, (uint8_t *) &sendData, sizeof(sendData));
-  }
+  // retransmits the last frame if its delivery failed
+  espNowLink.update();
 
+  // sleep until a button is pressed instead of spinning, the idle task gets the core in the meantime
+  // (only briefly while a retransmit is pending so its backoff isn't stretched)
+  buttons.wait(espNowLink.busy() ? 5 : IDLE_WAIT_MS);
 }
 
-// handles checking if button has been pressed and updating correlating data
-bool buttonPressed(dash_light &light) {
-  light.currBtnState = digitalRead(light.button_pin);
-
-  // first two conditions ensure that button goes from unpressed state to pressed state
-  // last condition only allows press if it occurs after threshold: currently 1 second (handles debouncing)
-  if (light.currBtnState == LOW && light.prevBtnState == HIGH && (millis() - light.lastUpdate) >= pressThreshold) {
-    // update button data and return pressed = true
-    light.prevBtnState = LOW;
-    light.lastUpdate = millis();
-    return true;
-  } else { 
-    // push data and return pressed = false 
-    light.prevBtnState = light.currBtnState;
-    return false;
+// scans for the AP the devkitV1 is connected to and returns its channel (0 if not found)
+int32_t getWiFiChannel(const char *ssid) {
+  int n = WiFi.scanNetworks();
+  for (int i = 0; i < n; i++) {
+    if (strcmp(ssid, WiFi.SSID(i).c_str()) == 0) {
+      return WiFi.channel(i);
+    }
   }
+  return 0;
 }
-
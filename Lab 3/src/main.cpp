@@ -1,16 +1,50 @@
 // Dealing with internet connection
 #include <secrets.h>
 #include <WiFi.h>
-#include <HttpClient.h>
+#include <Uplink.h> // keep-alive connection to the server (shared with the final project devkitV1)
 
-// Dealing with DHT20 and gathering info using SPI
-#include <SPI.h>
+// Dealing with DHT20 and gathering info using I2C
 #include <Wire.h>
-#include <Adafruit_AHTX0.h>
+#include <Aht20.h> // starts a conversion and picks the result up later instead of waiting on it
+#include <ClimateLog.h> // readings are kept in flash until the server has them
+#include <esp_timer.h>
+#include <atomic>
 #include <Arduino.h>
 
 // declare dht20 (temperature/humidity) sensor
-Adafruit_AHTX0 dht;
+Aht20 dht;
+
+// Number of milliseconds between readings
+const int kSampleInterval = 5000;
+
+// the sample clock: a periodic timer counts ticks and loop() starts one conversion per tick, so readings stay
+// kSampleInterval apart no matter how long the server takes to answer
+static std::atomic<uint32_t> sampleTicks{0};
+uint32_t ticksHandled = 0;
+unsigned long missedSamples = 0;
+esp_timer_handle_t sampleTimer;
+
+static void onSampleTick(void *arg) {
+  sampleTicks.fetch_add(1, std::memory_order_relaxed);
+}
+
+// every reading goes into the flash log first and is sent from there, so readings taken while the server or WiFi
+// is down (or before a reboot) go out once it's back
+ClimateLog readings;
+
+// at most this many readings per request, and at most one request every kReplayInterval ms, so catching up after
+// a long outage doesn't flood the server
+const size_t kBatchSize = 32;
+const unsigned long kReplayInterval = 250;
+// after a failed request the wait doubles up to this
+const unsigned long kMaxRetryInterval = 30*1000;
+
+ClimateRecord batch[kBatchSize];
+char batchBody[kBatchSize * CLIMATE_LINE_MAX + 1];
+uint32_t inFlightSeq = 0;  // last reading of the batch waiting for its response, 0 = none
+unsigned long nextSendMs = 0;
+unsigned long retryInterval = kReplayInterval;
+bool wifiConnected = false;
 
 void setup(){
   Serial.begin(115200);
@@ -22,6 +56,12 @@ void setup(){
     Serial.println("Didn't find DHT20");
   }  
 
+  if (readings.begin()) {
+    readings.printStats(Serial);
+  } else {
+    Serial.println("No flash partition for the readings log, readings won't be kept");
+  }
+
   // We start by connecting to a WiFi network
   delay(1000);
   Serial.println();
@@ -29,20 +69,17 @@ void setup(){
   Serial.print("Connecting to ");
   Serial.println(WIFI_SSID);
 
-  // connect to wifi (home wifi rn)
+  // connect to wifi (home wifi rn), loop() notices when it's up. Readings are taken and logged in the meantime
   WiFi.begin(WIFI_SSID, WIFI_PASS);
-  while (WiFi.status() != WL_CONNECTED) {
-      delay(500);
-      Serial.print(".");
-  }
 
-  // confirms that esp has internet connection
-  Serial.println("");
-  Serial.println("WiFi connected");
-  Serial.println("IP address: ");
-  Serial.println(WiFi.localIP());
-  Serial.println("MAC address: ");
-  Serial.println(WiFi.macAddress());
+  // first reading right away, then one every kSampleInterval
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = onSampleTick;
+  timerArgs.dispatch_method = ESP_TIMER_TASK;
+  timerArgs.name = "sample";
+  esp_timer_create(&timerArgs, &sampleTimer);
+  esp_timer_start_periodic(sampleTimer, kSampleInterval * 1000ULL);
+  sampleTicks.fetch_add(1, std::memory_order_relaxed);
 }
 
 
@@ -50,86 +87,108 @@ void setup(){
 // server IP is 128.85.32.135
 IPAddress serverAddr = IPAddress(128,85,32,135);
 uint16_t serverPort = 8080;
-// Path to download (this is the bit after the hostname in the URL
-// that you want to download
-String url;
 
 // Number of milliseconds to wait without receiving any data before we give up
 const int kNetworkTimeout = 30*1000;
-// Number of milliseconds to wait if no data is available before trying again
-const int kNetworkDelay = 1000;
 
-void loop() {
+// one connection to the server that stays open between readings (only reconnects if it drops)
+WiFiClient client;
+Uplink uplink(client, serverAddr, serverPort, "Azure Server", kNetworkTimeout);
 
+// a failed request waits longer before the next try, a good one resets the wait
+static void retryLater(bool failed) {
+  retryInterval = failed ? min(retryInterval * 2, kMaxRetryInterval) : kReplayInterval;
+  nextSendMs = millis() + retryInterval;
+  inFlightSeq = 0;
+}
 
-  // populate temp and humidity objects with fresh data
-  sensors_event_t humidity, temp;
-  dht.getEvent(&humidity, &temp);
+// posts the oldest unsent readings from the log, one line each (see formatReadings). If they don't all fit in
+// the body, the ones that do go now and the rest with the next batch
+static void sendBatch() {
+  size_t count = readings.peek(batch, kBatchSize);
+  if (count == 0) {
+    return;
+  }
 
-  url = "/?temperature=" + String(temp.temperature) + "&humidity=" + String(humidity.relative_humidity);
+  size_t written;
+  size_t len = formatReadings(batch, count, readings.boot(), millis(), batchBody, sizeof(batchBody), written);
+  if (written == 0) {
+    return;
+  }
 
+  if (uplink.post("/batch", "text/csv", batchBody, len)) {
+    inFlightSeq = batch[written - 1].seq;
+  } else {
+    Serial.println("Connect failed");
+    retryLater(true);
+  }
+}
 
-  int err =0;
-  
-  WiFiClient c;
-  HttpClient http(c);
+void loop() {
+  // start a conversion on every timer tick (a tick that comes while the last one is still converting is missed)
+  uint32_t ticks = sampleTicks.load(std::memory_order_relaxed);
+  if (ticks != ticksHandled) {
+    if (!dht.trigger()) {
+      missedSamples++;
+    }
+    missedSamples += ticks - ticksHandled - 1;
+    ticksHandled = ticks;
+  }
 
-  err = http.get(serverAddr, "Azure Server", serverPort, url.c_str());
-  if (err == 0)
-  {
-    Serial.println("\nstartedRequest ok");
-
-    err = http.responseStatusCode();
-    if (err >= 0)
-    {
-      Serial.println("\nResponse status: " + String(err));
-
-      err = http.skipResponseHeaders();
-      if (err >= 0)
-      {
-        int bodyLen = http.contentLength();
-        Serial.println("HTTP Response Body:");
-      
-        // Now we've got to the body, so we can print it out
-        unsigned long timeoutStart = millis();
-        char c;
-        // Whilst we haven't timed out & haven't reached the end of the body
-        while ( (http.connected() || http.available()) && ((millis() - timeoutStart) < kNetworkTimeout) )
-        {
-            if (http.available())
-            {
-                c = http.read();
-                // Print out this character
-                Serial.print(c);
-               
-                bodyLen--;
-                // We read something, reset the timeout counter
-                timeoutStart = millis();
-            }
-            else
-            {
-                // We haven't got any data, so let's pause to allow some to arrive
-                delay(kNetworkDelay);
-            }
-        }
-
-        Serial.println();
-      }
-      else
-      {
-        Serial.println("Failed to skip response headers: " + err);
-      }
+  // picks up the reading once the sensor has finished, returns right away until then
+  ClimateReading reading;
+  int result = dht.collect(reading);
+  if (result == AHT20_READY) {
+    if (!readings.append(reading)) {
+      Serial.println("Couldn't log reading");
     }
-    else
-    {    
-      Serial.println("Getting response failed: " + err);
+  } else if (result == AHT20_ERROR) {
+    Serial.println("DHT20 reading failed");
+  }
+
+  // confirms that esp has internet connection (the ESP32 reconnects on its own when it drops)
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected != wifiConnected) {
+    wifiConnected = connected;
+    if (connected) {
+      Serial.println("WiFi connected");
+      Serial.println("IP address: ");
+      Serial.println(WiFi.localIP());
+      Serial.println("MAC address: ");
+      Serial.println(WiFi.macAddress());
+      nextSendMs = millis();
+      retryInterval = kReplayInterval;
+    } else {
+      Serial.println("WiFi lost, logging readings until it's back");
     }
   }
-  else
-  {
-    Serial.println("Connect failed: " + err);
+
+  // one batch in flight at a time, a slow server doesn't hold up the sampling since responses are checked below
+  if (connected && inFlightSeq == 0 && (long) (millis() - nextSendMs) >= 0 && readings.unsent() > 0) {
+    sendBatch();
   }
-  http.stop();
 
-  delay(5000);
+  // handles whatever part of the response has arrived and returns straight away
+  int status = uplink.poll();
+  if (status > 0)
+  {
+    // only a 200 means the server has the batch, anything else is sent again later
+    if (status == 200 && inFlightSeq != 0) {
+      readings.ack(inFlightSeq);
+    }
+    retryLater(status != 200);
+
+    Serial.println("\nResponse status: " + String(status));
+    Serial.println("HTTP Response Body:");
+    Serial.println(uplink.body());
+    uplink.printStats(Serial);
+    dht.printStats(Serial);
+    readings.printStats(Serial);
+    Serial.printf("%lu samples missed\n", missedSamples);
+  }
+  else if (status < 0)
+  {
+    Serial.println("Request failed: " + String(status));
+    retryLater(true);
+  }
 }
\ No newline at end of file
@@ -2,31 +2,77 @@
 
 from flask import Flask
 from flask import request
+from werkzeug.serving import WSGIRequestHandler
+from datetime import datetime, timedelta
+from collections import deque
 
 app = Flask(__name__)
 
+# answer with HTTP/1.1 so the ESP32 can keep one connection open instead of reconnecting per reading
+WSGIRequestHandler.protocol_version = "HTTP/1.1"
+
 # Variables to store last pulled values
 last_temp = None
 last_humidity = None
+last_measured = None
+
+# sequence numbers of recently received logged readings, so a batch the ESP32 sends again (because it didn't get
+# our answer) isn't counted twice
+recent_seqs = deque(maxlen=1024)
 
 @app.route("/")
 def hello():
-    global last_temp, last_humidity
+    global last_temp, last_humidity, last_measured
 
     # Get temperature and humidity from URL arguments
     temp = request.args.get('temperature')
     humidity = request.args.get('humidity')
 
+    measured = datetime.now()
+
     if temp is not None and humidity is not None:
         # If both are present in the URL, update the last values
         last_temp = temp
         last_humidity = humidity
-        print(f"{'\033[0m'}Temp: {temp} C  /  Humidity: {humidity} % rH{'\033[32m'}")
-        return f"We received temperature: {temp} and humidity: {humidity}"
+        last_measured = measured
+        print(f"{'\033[0m'}{measured:%H:%M:%S} Temp: {temp} C  /  Humidity: {humidity} % rH{'\033[32m'}")
+        return f"We received temperature: {temp} and humidity: {humidity} measured at {measured:%H:%M:%S}"
 
     # If no URL parameters, use the last pulled values
     if last_temp is not None and last_humidity is not None:
-        return f"No new data given. Prev Temperature: {last_temp} and Previous Humidity: {last_humidity}"
+        when = f"measured at {last_measured:%H:%M:%S}" if last_measured else "measured before a restart"
+        return f"No new data given. Prev Temperature: {last_temp} and Previous Humidity: {last_humidity} ({when})"
 
     # If no data at all, return an error message
-    return "No temperature or humidity data available."
\ No newline at end of file
+    return "No temperature or humidity data available."
+
+# route for readings the ESP32 kept in its flash log, sent oldest first, one per line:
+# "<seq>,<boot>,<age ms>,<temperature>,<humidity>". seq counts up over the life of the log, age (how long before
+# the request it was measured) is empty for readings from before the ESP32 last restarted
+@app.route("/batch", methods=["POST"])
+def batch():
+    global last_temp, last_humidity, last_measured
+
+    now = datetime.now()
+    lines = request.get_data(as_text=True).splitlines()
+    received = 0
+    for line in lines:
+        fields = line.split(",")
+        if len(fields) != 5:
+            return f"Bad reading line '{line}'", 400
+
+        seq, boot, age, temp, humidity = fields
+        if seq in recent_seqs:
+            continue
+        recent_seqs.append(seq)
+
+        measured = now - timedelta(milliseconds=int(age)) if age else None
+        when = f"{measured:%H:%M:%S}" if measured else f"boot {boot}"
+        print(f"{'\033[0m'}#{seq} {when} Temp: {temp} C  /  Humidity: {humidity} % rH{'\033[32m'}")
+
+        last_temp = temp
+        last_humidity = humidity
+        last_measured = measured
+        received += 1
+
+    return f"{received} readings received"
\ No newline at end of file
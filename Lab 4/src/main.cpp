@@ -1,78 +1,189 @@
 #include <Arduino.h>
 #include <BLEDevice.h>
 #include <BLE2902.h> // assists in automatic updates rather than having phone confirm sync for each change
+#include <esp_sleep.h>
+#include <driver/gpio.h>
 
-// for using the accelerometer
-#include <SparkFunLSM6DSO.h>
-LSM6DSO myIMU; //Default constructor is I2C, addr 0x6B
+// for using the accelerometer, sampled at a fixed rate into its FIFO (addr 0x6B)
+#include <Lsm6dsoFifo.h>
+#include <AccelKernel.h>
+#include <StepDetector.h>
+Lsm6dsoFifo myIMU;
+
+// finds steps as the samples come in, adapting to how hard they are (no calibration)
+StepDetector detector;
+
+// or the accelerometer counts them itself and only wakes us up for a step
+#include <Lsm6dsoPedometer.h>
+Lsm6dsoPedometer pedometer;
+
+// 1 = count with the LSM6DSO's pedometer and sleep between steps, the software detector is the fallback (if the
+// pedometer can't be set up, or the phone writes "s")
+// 0 = start with the software detector (build with -DHARDWARE_STEPS=0, also to record traces for step_replay)
+#ifndef HARDWARE_STEPS
+#define HARDWARE_STEPS 1
+#endif
+
+// 1 = light sleep between steps, woken by INT1. The BT controller only keeps a connection through light sleep
+// with its modem sleep clocked from a 32 kHz crystal, if the phone keeps losing it build with
+// -DPEDOMETER_LIGHT_SLEEP=0 to block on the step interrupt instead (the CPU idles, the radio stays up)
+#ifndef PEDOMETER_LIGHT_SLEEP
+#define PEDOMETER_LIGHT_SLEEP 1
+#endif
 
 // LED pin
 #define LED GPIO_NUM_26
 
-// var for actually counting steps
-int stepCount = 0;
+// LSM6DSO INT1, goes high when the FIFO has samples to drain or the pedometer counted a step (input only pin,
+// INT1 drives it both ways)
+#define IMU_INT1 GPIO_NUM_34
+
+// one burst of samples drained from the FIFO, their squared magnitudes and the steps found in them
+ImuSample samples[LSM6DSO_BURST_WORDS];
+uint32_t squaredMags[LSM6DSO_BURST_WORDS];
+StepEvent steps[LSM6DSO_BURST_WORDS];
+bool counting = false;
 
+// which of the two is counting, and the one the phone asked to switch to ('p' or 's', 0 = no change)
+bool hardwareSteps = false;
+volatile char requestedMode = 0;
 
-// calculated during callibration phase, helps determine threshold
-float restingAvg;
-float sd;
-float maxMag = 0;
-float totalMag = 0;
-float threshold;
+// last count read from the pedometer, it only ever goes up (and wraps at 65535)
+uint16_t pedometerSteps = 0;
 
-bool stepped = false;
-bool callibrating = false;
+// times loop() had something to do (a FIFO to drain, a step interrupt or the stats) and steps counted, both
+// since the mode started, to compare what a step costs in CPU wake-ups
+unsigned long wakeUps = 0;
+unsigned long modeSteps = 0;
+
+const unsigned long kStatsInterval = 10000;
+unsigned long lastStatsMs = 0;
+
+// how long to wait before trying again if light sleep is refused
+const unsigned long kSleepRefusedMs = 200;
+
+// var for actually counting steps
+int stepCount = 0;
 
 
 // vars for bluetooth connection
 #define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 #define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+#define STATUS_CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a9"
 BLEServer *pServer;
 BLEService *pService;
 BLECharacteristic *pCharacteristic;
+// read-only text on how the counting is going, kept apart so the step characteristic only ever holds the count
+BLECharacteristic *pStatusCharacteristic;
+
+// one line on how the counting is going, for the serial monitor and a phone that writes "?"
+std::string step_status() {
+  char status[96];
+  snprintf(status, sizeof(status), "%s: %lu steps, %lu wake-ups (%.2f per step)",
+           hardwareSteps ? "pedometer" : "software", modeSteps, wakeUps,
+           modeSteps > 0 ? (float) wakeUps / modeSteps : 0.0f);
+  return status;
+}
 
-void callibrate_accelerometer();
-float get_magnitude();
- 
 // handles deliverable A that'll process data received
 class MyCallbacks: public BLECharacteristicCallbacks {
   void onWrite(BLECharacteristic *pCharacteristic) {
     std::string value = pCharacteristic->getValue();
 
-    // if incoming data starts with 0, turn LED off (only when program isn't callibrating accelerometer)
-    if (value[0] == '0' && !callibrating) {
+    // if incoming data starts with 0, turn LED off
+    if (value[0] == '0') {
       Serial.println("Received 0. Turning LED off.");
       digitalWrite(LED, LOW);
     }
-    // if incoming data starts with 1, turn LED on (only when program isn't callibrating accelerometer)
-    else if (value[0] == '1' && !callibrating) {
+    // if incoming data starts with 1, turn LED on
+    else if (value[0] == '1') {
       Serial.println("Received 1. Turning LED on.");
       digitalWrite(LED, HIGH);
     }
+    // p/s switch to the pedometer/software detector, at loop()'s next wake-up (they share the sensor)
+    else if (value[0] == 'p' || value[0] == 's') {
+      Serial.printf("Received %c. Switching step counting.\n", value[0]);
+      requestedMode = value[0];
+    }
+    // ? answers with the mode and wake-ups per step on the status characteristic
+    else if (value[0] == '?') {
+      pStatusCharacteristic->setValue(step_status());
+      pStatusCharacteristic->notify();
+    }
   }
 };
+
+// adds steps to the count and sends it to subscribed devices
+void add_steps(int steps) {
+  stepCount += steps;
+  modeSteps += steps;
+  if (steps == 1)
+    Serial.println("Step taken!");
+  else
+    Serial.printf("%d steps taken!\n", steps);
+
+  // send value to subscribed devices
+  pCharacteristic->setValue(std::to_string(stepCount));
+  pCharacteristic->notify();
+}
+
+// counting with the sensor's pedometer from now on, false if it couldn't be set up
+bool start_pedometer() {
+  // off with the FIFO's watermark handler, with light sleep nothing but the wake-up watches INT1
+  detachInterrupt(IMU_INT1);
+  if (!pedometer.begin(PEDOMETER_LIGHT_SLEEP ? -1 : IMU_INT1)) {
+    return false;
+  }
+  hardwareSteps = true;
+  pedometerSteps = 0;
+  wakeUps = 0;
+  modeSteps = 0;
+  Serial.println("Counting steps with the LSM6DSO pedometer");
+  return true;
+}
+
+// counting with the software detector from the FIFO samples from now on
+bool start_software() {
+  gpio_wakeup_disable(IMU_INT1);
+  hardwareSteps = false;
+  counting = false;
+  detector.reset();
+  wakeUps = 0;
+  modeSteps = 0;
+  Serial.println("Counting steps in software");
+  return myIMU.begin(IMU_INT1);
+}
+
+// sleeps until INT1 says there's been a step, or the stats are due
+void wait_for_step() {
+  unsigned long untilStats = kStatsInterval - min(millis() - lastStatsMs, kStatsInterval);
+#if PEDOMETER_LIGHT_SLEEP
+  // INT1 is latched until the count is read, so a step while we were awake still wakes us straight away
+  gpio_wakeup_enable(IMU_INT1, GPIO_INTR_HIGH_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup(max(untilStats, 1UL) * 1000ULL);
+  Serial.flush(); // the UART stops while asleep
+  if (esp_light_sleep_start() != ESP_OK) {
+    delay(min(untilStats, kSleepRefusedMs));
+  }
+#else
+  pedometer.wait(untilStats);
+#endif
+}
  
 void setup() {
   pinMode(LED, OUTPUT);
   Serial.begin(115200);
 
-  // Setup for accelerometer and getting data through I2C (taken from lib examples)
-  Wire.begin();
-  delay(10);
-  if( myIMU.begin() )
+  // Setup for accelerometer: its own pedometer, or a fixed data rate, FIFO and watermark interrupt for the
+  // software detector
+  if( (HARDWARE_STEPS && start_pedometer()) || start_software() )
     Serial.println("Ready.");
   else { 
     Serial.println("Could not connect to IMU.");
     Serial.println("Freezing");
   }
 
-  if( myIMU.initialize(BASIC_SETTINGS) ) {
-    Serial.println("Loaded Settings.");
-  }
-
-  // goes through process of determining threshold 
-  callibrate_accelerometer();
-
   // setting up the bluetooth connection + handling notifications (mostly taken from Lab 4 Information)
   BLEDevice::init("CSGroup5"); // setups device name as CSGroup5
   pServer = BLEDevice::createServer();
@@ -90,6 +201,14 @@ void setup() {
   
   // will allow client to "subscribe" to notifications and check flag values before notifs
   pCharacteristic->addDescriptor(new BLE2902()); 
+
+  pStatusCharacteristic = pService->createCharacteristic(
+                                          STATUS_CHARACTERISTIC_UUID,
+                                          BLECharacteristic::PROPERTY_READ |
+                                          BLECharacteristic::PROPERTY_NOTIFY
+                                        );
+  pStatusCharacteristic->setValue(step_status());
+  pStatusCharacteristic->addDescriptor(new BLE2902());
   /*
   BLE2902 is a descriptor updating client characteristics configuration 
     - notification is fire and forget
@@ -100,90 +219,60 @@ void setup() {
   
   BLEAdvertising *pAdvertising = pServer->getAdvertising();
   pAdvertising->start();
+
+  lastStatsMs = millis();
 }
  
 void loop() {
-  float mag = get_magnitude();
-
-  // only consider it a step if the magnitude passes threshold and a step isn't in motion already
-  if (mag > threshold && !stepped) {
-    stepped = true;
-    stepCount++;
-    Serial.println("Step taken!");
-
-    // send value to subscribed devices
-    pCharacteristic->setValue(std::to_string(stepCount));
-    pCharacteristic->notify();
-  } 
-  // ensure that step is only finished when magnitude falls below the threshold (prevents multiple step counts at once)
-  else if (mag < threshold && stepped) {
-    stepped = false;
+  if (requestedMode != 0) {
+    bool pedometerWanted = requestedMode == 'p';
+    requestedMode = 0;
+    if (pedometerWanted != hardwareSteps && !(pedometerWanted && start_pedometer())) {
+      start_software();
+    }
   }
 
-  delay(100);
-}
-
-void callibrate_accelerometer() {
-  Serial.println("Callibrating: Stand still for 5 seconds...");
-  callibrating = true;
-  digitalWrite(LED, HIGH); // when LED turns on, phase A is signified (stand still to get resting value)
-
-  // PHASE A: 500 iterations with 20ms delays = 5s of calibration still
-  for (int i = 0; i < 500; i++) {
-    float mag = get_magnitude();
-
-    maxMag = max(maxMag, mag);
-    totalMag += mag;
-    delay(20);
+  if (hardwareSteps) {
+    // asleep until the pedometer counts a step, then a single read of its count
+    wait_for_step();
+    wakeUps++;
+    uint16_t count;
+    if (pedometer.steps(count) && count != pedometerSteps) {
+      add_steps((uint16_t) (count - pedometerSteps));
+      pedometerSteps = count;
+    }
   }
+  // nothing to do until the FIFO reaches its watermark, then every sample since the last drain is handled in order
+  else if (myIMU.ready()) {
+    wakeUps++;
+    size_t count;
+    do {
+      count = myIMU.read(samples, LSM6DSO_BURST_WORDS);
+      accelSquaredMagnitudes(samples, count, squaredMags);
+      size_t found = detector.feed(samples, squaredMags, count, steps);
 
-  // gives us an avg for the resting magnitude
-  restingAvg = totalMag / 500;
+      if (detector.ready() && !counting) {
+        counting = true;
+        Serial.printf("Counting steps, %.2f s after the IMU started\n", detector.stats().readyIndex / (float) LSM6DSO_ODR_HZ);
+      }
 
-  Serial.println("Callibrating: Take a few steps for 5 seconds...");
-  digitalWrite(LED, LOW); // turns LED off to signify phase B (take steps)
-  
-
-  // PHASE B: 500 iterations with 20ms delays = 5s of calibration walking
-  for (int i = 0; i < 500; i++) {
-    float mag = get_magnitude();
+      for (size_t i = 0; i < found; i++) {
+        add_steps(1);
+      }
+    } while (count == LSM6DSO_BURST_WORDS);
+  }
 
-    // rather than just taking the max, avg out between the two magnitudes to avoid having
-    // one hard step resulting in a high threshold
-    if (mag > maxMag) {
-      maxMag = (mag + maxMag) / 2;
+  if (millis() - lastStatsMs >= kStatsInterval) {
+    lastStatsMs = millis();
+    if (hardwareSteps) {
+      pedometer.printStats(Serial);
+    } else {
+      myIMU.printStats(Serial);
+      detector.printStats(Serial);
     }
-    
-    delay(20);
+    Serial.printf("Steps %s\n", step_status().c_str());
+    // fresh for a phone that just reads it, only "?" notifies
+    pStatusCharacteristic->setValue(step_status());
   }
-
-  // rough std dev that assumes max is 3 standard deviations above mean
-  sd = (maxMag - restingAvg) / 3; 
-  
-  // can tweak the multiplier to modify threshold
-  // here it allows ~16% of the higher end of the bell curve 
-  threshold = restingAvg + (0.9 * sd);
-  
-
-  Serial.printf("Callibration Done! Threshold: %.3f\n", threshold);
-  callibrating = false;
-
-  digitalWrite(LED, HIGH);
-  delay(250);
-  digitalWrite(LED, LOW);
-  delay(250);
-  digitalWrite(LED, HIGH);
-  delay(250);
-  digitalWrite(LED, LOW);
-  delay(250);
-}
-
-// uses all 3 axes and combines to get a magnitude value moving in any direction
-float get_magnitude() {
-  float ax = myIMU.readFloatAccelX();
-  float ay = myIMU.readFloatAccelY();
-  float az = myIMU.readFloatAccelZ();
-
-  return sqrt(pow(ax, 2) + pow(ay, 2) + pow(az, 2));
 }
 
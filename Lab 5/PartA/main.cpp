@@ -2,29 +2,37 @@
 #include <BLEDevice.h>
 #include <BLE2902.h> // assists in automatic updates rather than having phone confirm sync for each change
 
-// for using the accelerometer
-#include <SparkFunLSM6DSO.h>
-LSM6DSO myIMU; //Default constructor is I2C, addr 0x6B
+// for using the accelerometer, sampled at a fixed rate into its FIFO (addr 0x6B)
+#include <Lsm6dsoFifo.h>
+#include <AccelKernel.h>
+#include <StepDetector.h>
+#include <MotionClassifier.h>
+Lsm6dsoFifo myIMU;
+
+// finds footfalls as the samples come in, adapting to how hard they are (no calibration)
+StepDetector detector;
+
+// sorts them into steps and jumps by the vertical acceleration (along a running gravity estimate)
+MotionClassifier classifier;
+
+// LSM6DSO INT1, goes high when the FIFO has samples to drain (input only pin, INT1 drives it both ways)
+#define IMU_INT1 GPIO_NUM_34
+
+// one burst of samples drained from the FIFO, their squared magnitudes, the footfalls found in them and what
+// they turned out to be
+ImuSample samples[LSM6DSO_BURST_WORDS];
+uint32_t squaredMags[LSM6DSO_BURST_WORDS];
+StepEvent footfalls[LSM6DSO_BURST_WORDS];
+MotionEvent motions[MOTION_MAX_EVENTS];
+bool counting = false;
+
+const unsigned long kStatsInterval = 10000;
+unsigned long lastStatsMs = 0;
 
 // var for actually counting steps/jumps
 int stepCount = 0;
 int jumpCount = 0;
 
-bool stepping = false;
-bool jumping = false;
-
-// calculated during callibration phase, helps determine threshold
-float restingAvg;
-float sd;
-float maxMag = 0;
-float totalMag = 0;
-float stepThreshold;
-float jumpThreshold;
-
-// float grav_x = 0.0;
-// float grav_y = 0.0;
-// float grav_z = 0.0;
-bool calibrated = false;
 
 // vars for bluetooth connection
 #define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
@@ -33,11 +41,6 @@ BLEServer *pServer;
 BLEService *pService;
 BLECharacteristic *pCharacteristic;
 
-// void calibrateGravityDirection();
-// float getVerticalAcceleration();
-
-void callibrate_accelerometer();
-float get_magnitude();
  
 // handles deliverable A that'll process data received
 class MyCallbacks: public BLECharacteristicCallbacks {
@@ -49,24 +52,14 @@ class MyCallbacks: public BLECharacteristicCallbacks {
 void setup() {
   Serial.begin(115200);
 
-  // Setup for accelerometer and getting data through I2C (taken from lib examples)
-  Wire.begin();
-  delay(10);
-  if( myIMU.begin() )
+  // Setup for accelerometer: fixed data rate, FIFO and watermark interrupt
+  if( myIMU.begin(IMU_INT1) )
     Serial.println("Ready.");
   else { 
     Serial.println("Could not connect to IMU.");
     Serial.println("Freezing");
   }
 
-  if( myIMU.initialize(BASIC_SETTINGS) ) {
-    Serial.println("Loaded Settings.");
-  }
-
-  // goes through process of determining threshold 
-  callibrate_accelerometer();
-  // calibrateGravityDirection();
-
   // setting up the bluetooth connection + handling notifications (mostly taken from Lab 4 Information)
   BLEDevice::init("CSGroup5"); // setups device name as CSGroup5
   pServer = BLEDevice::createServer();
@@ -95,148 +88,53 @@ void setup() {
   BLEAdvertising *pAdvertising = pServer->getAdvertising();
   pAdvertising->start();
 
+  lastStatsMs = millis();
+
   Serial.println("Begin testing");
 }
  
 void loop() {
-  float mag = get_magnitude();
-
-  if (mag > jumpThreshold && !jumping) {
-    jumping = true;
-    jumpCount++;
-    Serial.println("Jumped!");
-
-    delay(500);
-  }
-  // only consider it a step if the magnitude passes threshold and a step isn't in motion already
-  else if (mag > stepThreshold && !stepping) {
-    stepping = true;
-    stepCount++;
-    Serial.println("Step taken!");
-
-    // send value to subscribed devices
-    pCharacteristic->setValue("Steps: " + std::to_string(stepCount) + " Jumps: " + std::to_string(jumpCount));
-    pCharacteristic->notify();
-  } 
-  else if (mag < jumpThreshold && jumping) {
-    jumping = false;
-  }
-  // ensure that step is only finished when magnitude falls below the threshold (prevents multiple step counts at once)
-  else if (mag < stepThreshold && stepping) {
-    stepping = false;
-  }
-
-  delay(100);
-}
-
-void callibrate_accelerometer() {
-  Serial.println("Callibrating: Stand still for 10 seconds...");
-  calibrated = false;
-
-  // PHASE A: 500 iterations with 20ms delays = 10s of calibration still
-  for (int i = 0; i < 500; i++) {
-    float mag = get_magnitude();
-
-    maxMag = max(maxMag, mag);
-    totalMag += mag;
-    delay(20);
+  // nothing to do until the FIFO reaches its watermark, then every sample since the last drain is handled in order
+  if (!myIMU.ready()) {
+    return;
   }
 
-  // gives us an avg for the resting magnitude
-  restingAvg = totalMag / 500;
-
-  Serial.println("Callibrating: Take a few steps for 10 seconds...");
-
-  // PHASE B: 500 iterations with 20ms delays = 10s of calibration walking
-  for (int i = 0; i < 500; i++) {
-    float mag = get_magnitude();
-    // rather than just taking the max, avg out between the two magnitudes to avoid having
-    // one hard step resulting in a high threshold
-    if (mag > maxMag) {
-      maxMag = (mag + maxMag) / 2;
+  size_t count;
+  do {
+    count = myIMU.read(samples, LSM6DSO_BURST_WORDS);
+    accelSquaredMagnitudes(samples, count, squaredMags);
+    size_t found = detector.feed(samples, squaredMags, count, footfalls);
+    size_t classified = classifier.feed(samples, count, footfalls, found, motions);
+
+    if (detector.ready() && classifier.ready() && !counting) {
+      counting = true;
+      Serial.printf("Counting, %.2f s after the IMU started\n",
+                    max(detector.stats().readyIndex, classifier.stats().readyIndex) / (float) LSM6DSO_ODR_HZ);
     }
-    
-    delay(20);
-  }
 
-  // rough std dev that assumes max is 3 standard deviations above mean
-  sd = (maxMag - restingAvg) / 3; 
-  
-  // can tweak the multiplier to modify threshold
-  // here it allows the higher end of the bell curve 
-  stepThreshold = restingAvg + (0.7 * sd);
-
-  Serial.println("Callibrating: Jump 3-5 times in the next 10 seconds...");
-  
-  // PHASE C: Jump calibration
-  float maxMag = 0;
-  for (int i = 0; i < 500; i++) {
-    float mag = get_magnitude();
-    if (mag > maxMag) {
-      maxMag = (mag + maxMag) / 2;
+    for (size_t i = 0; i < classified; i++) {
+      const MotionEvent &motion = motions[i];
+      if (motion.kind == MOTION_JUMP) {
+        jumpCount++;
+        // h = g t^2 / 8 for t in the air, half of it going up
+        Serial.printf("Jumped! %.2f s in the air (~%.0f cm)\n", motion.airtime,
+                      9.81f * motion.airtime * motion.airtime / 8 * 100);
+      }
+      else {
+        stepCount++;
+        Serial.println("Step taken!");
+      }
+
+      // send value to subscribed devices
+      pCharacteristic->setValue("Steps: " + std::to_string(stepCount) + " Jumps: " + std::to_string(jumpCount));
+      pCharacteristic->notify();
     }
-    delay(20);
-  }
-
-  // relies on counting jump on the heavy magnitude impact when landing
-  sd = (maxMag - restingAvg) / 3; 
-  jumpThreshold = restingAvg + (0.8 * sd);
-  
-  Serial.printf("Callibration Done!\n");
-  Serial.printf("Resting Avg: %.3f\n", restingAvg);
-  Serial.printf("Step Threshold: %.3f\n", stepThreshold);
-  Serial.printf("Jump Threshold: %.3f\n", jumpThreshold);
-  calibrated = true;
-
-  delay(5000);
-}
-
-// uses all 3 axes and combines to get a magnitude value moving in any direction
-float get_magnitude() {
-  float ax = myIMU.readFloatAccelX();
-  float ay = myIMU.readFloatAccelY();
-  float az = myIMU.readFloatAccelZ();
-
-  return sqrt(pow(ax, 2) + pow(ay, 2) + pow(az, 2));
-}
-
+  } while (count == LSM6DSO_BURST_WORDS);
 
-
-// void calibrateGravityDirection() {
-//   float sum_x = 0.0, sum_y = 0.0, sum_z = 0.0;
-
-//   Serial.println("Callibrating: Stand still for 3 seconds...");
-  
-//   for (int i = 0; i < 300; i++) {
-//     sum_x += myIMU.readFloatAccelX();
-//     sum_y += myIMU.readFloatAccelY();
-//     sum_z += myIMU.readFloatAccelZ();
-
-//     delay(10);
-//   }
-  
-//   // Average the samples
-//   grav_x = sum_x / 300;
-//   grav_y = sum_y / 300;
-//   grav_z = sum_z / 300;
-  
-//   // Normalize the gravity vector
-//   float gravity_magnitude = sqrt(pow(grav_x, 2) + pow(grav_y, 2) + pow(grav_z, 2));
-  
-//   grav_x /= gravity_magnitude;
-//   grav_y /= gravity_magnitude;
-//   grav_z /= gravity_magnitude;
-  
-//   calibrated = true;
-// }
-
-// float getVerticalAcceleration() {
-//   float ax = myIMU.readFloatAccelX();
-//   float ay = myIMU.readFloatAccelY();
-//   float az = myIMU.readFloatAccelZ();
-
-//   // takes acceration data and isolates vertical accel using gravity
-//   float vertical_component = ax * grav_x + ay * grav_y + az * grav_z;
-  
-//   return vertical_component;
-// }
\ No newline at end of file
+  if (millis() - lastStatsMs >= kStatsInterval) {
+    lastStatsMs = millis();
+    myIMU.printStats(Serial);
+    detector.printStats(Serial);
+    classifier.printStats(Serial);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include "AccelKernel.h"
+
+uint32_t accelThresholdSquared(float g) {
+  // in double, float can't hold a square this size exactly (once per calibration, not per sample)
+  double counts = g > 0 ? g / LSM6DSO_G_PER_LSB : 0;
+  double squared = counts * counts;
+  return squared >= UINT32_MAX ? UINT32_MAX : (uint32_t) squared;
+}
+
+void accelSquaredMagnitudes(const ImuSample *samples, size_t n, uint32_t *squared) {
+  for (size_t i = 0; i < n; i++) {
+    int32_t x = samples[i].x;
+    int32_t y = samples[i].y;
+    int32_t z = samples[i].z;
+    // each square fits int32 (up to 2^30), their sum only fits unsigned
+    squared[i] = (uint32_t) (x * x) + (uint32_t) (y * y) + (uint32_t) (z * z);
+  }
+}
+
+uint32_t accelAboveMask(const uint32_t *squared, size_t n, uint32_t thresholdSquared) {
+  // without branches, whether a sample is above doesn't cost a mispredicted jump
+  uint32_t mask = 0;
+  for (size_t i = 0; i < n; i++) {
+    mask |= (uint32_t) (squared[i] > thresholdSquared) << i;
+  }
+  return mask;
+}
+
+float accelMagnitude(uint32_t squared) {
+  return sqrtf((float) squared) * LSM6DSO_G_PER_LSB;
+}
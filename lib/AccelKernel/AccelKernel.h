@@ -0,0 +1,27 @@
+// AccelKernel - threshold tests on whole FIFO blocks of raw accelerometer samples in integer math. The step
+// counters only ever compare the magnitude with a threshold, so instead of converting every axis to float and
+// taking sqrt(pow(ax, 2) + ...) per sample, a block's squared magnitudes are summed from the int16 counts and
+// compared with the squared threshold (also in counts). No float, no sqrt, and pow() on the ESP32 is done
+// in software doubles
+//
+// |a| > t is the same as |a|^2 > t^2 for the non-negative values here, and the squares are exact in uint32
+// (3 * 32768^2 < 2^32), so only samples within float rounding of the threshold can come out differently
+
+#ifndef ACCEL_KERNEL_H
+#define ACCEL_KERNEL_H
+
+#include <Lsm6dsoFifo.h>
+
+// a threshold in g as squared raw counts, what the squared magnitudes are compared with
+uint32_t accelThresholdSquared(float g);
+
+// squared magnitude of every sample in the block, in raw counts squared
+void accelSquaredMagnitudes(const ImuSample *samples, size_t n, uint32_t *squared);
+
+// bit i is set where squared[i] > thresholdSquared, so n can be at most 32 (a burst is 18)
+uint32_t accelAboveMask(const uint32_t *squared, size_t n, uint32_t thresholdSquared);
+
+// magnitude in g from a squared magnitude, for the few places that need the value itself (calibration)
+float accelMagnitude(uint32_t squared);
+
+#endif
@@ -0,0 +1,119 @@
+#include "Aht20.h"
+
+// commands and status bits from the AHT20 datasheet
+#define AHT20_CMD_INIT    0xBE  // load calibration (args 0x08 0x00)
+#define AHT20_CMD_TRIGGER 0xAC  // start a conversion (args 0x33 0x00)
+#define AHT20_CMD_RESET   0xBA
+#define AHT20_STATUS_BUSY       0x80
+#define AHT20_STATUS_CALIBRATED 0x08
+
+// CRC-8 the sensor appends to a reading: polynomial 0x31, starts at 0xFF
+static uint8_t crc8(const uint8_t *data, size_t len) {
+  uint8_t crc = 0xFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+bool Aht20::command(uint8_t cmd, uint8_t arg0, uint8_t arg1) {
+  wire.beginTransmission(address);
+  wire.write(cmd);
+  wire.write(arg0);
+  wire.write(arg1);
+  return wire.endTransmission() == 0;
+}
+
+bool Aht20::begin() {
+  wire.begin();
+
+  wire.beginTransmission(address);
+  wire.write(AHT20_CMD_RESET);
+  if (wire.endTransmission() != 0) {
+    return false;
+  }
+  delay(20);
+
+  if (wire.requestFrom(address, (uint8_t) 1) != 1) {
+    return false;
+  }
+  if (!(wire.read() & AHT20_STATUS_CALIBRATED)) {
+    if (!command(AHT20_CMD_INIT, 0x08, 0x00)) {
+      return false;
+    }
+    delay(10);
+  }
+  converting = false;
+  return true;
+}
+
+bool Aht20::trigger() {
+  if (converting) {
+    return false;
+  }
+  if (!command(AHT20_CMD_TRIGGER, 0x33, 0x00)) {
+    counters.errors++;
+    return false;
+  }
+  converting = true;
+  triggeredMs = millis();
+  waitMs = AHT20_CONVERSION_MS;
+  return true;
+}
+
+int Aht20::fail() {
+  converting = false;
+  counters.errors++;
+  return AHT20_ERROR;
+}
+
+int Aht20::collect(ClimateReading &reading) {
+  if (!converting) {
+    return AHT20_IDLE;
+  }
+
+  unsigned long elapsed = millis() - triggeredMs;
+  if (elapsed < waitMs) {
+    // not even worth asking yet
+    return AHT20_WAITING;
+  }
+
+  unsigned long start = micros();
+
+  // status, 5 bytes of humidity/temperature (20 bits each) and the CRC
+  uint8_t data[7];
+  if (wire.requestFrom(address, (uint8_t) sizeof(data)) != sizeof(data)) {
+    return fail();
+  }
+  for (uint8_t i = 0; i < sizeof(data); i++) {
+    data[i] = wire.read();
+  }
+
+  if (data[0] & AHT20_STATUS_BUSY) {
+    counters.busyPolls++;
+    waitMs = elapsed + AHT20_BUSY_RETRY_MS;
+    return elapsed >= AHT20_TIMEOUT_MS ? fail() : AHT20_WAITING;
+  }
+  if (crc8(data, 6) != data[6]) {
+    return fail();
+  }
+
+  uint32_t rawHumidity = ((uint32_t) data[1] << 12) | ((uint32_t) data[2] << 4) | (data[3] >> 4);
+  uint32_t rawTemperature = ((uint32_t) (data[3] & 0x0F) << 16) | ((uint32_t) data[4] << 8) | data[5];
+  reading.takenMs = triggeredMs;
+  reading.humidity = rawHumidity * 100.0f / 1048576.0f;
+  reading.temperature = rawTemperature * 200.0f / 1048576.0f - 50.0f;
+
+  converting = false;
+  counters.readings++;
+  counters.maxCollectUs = max(counters.maxCollectUs, micros() - start);
+  return AHT20_READY;
+}
+
+void Aht20::printStats(Print &out) const {
+  out.printf("AHT20: %lu readings, %lu errors, %lu busy polls, longest collect %lu us\n",
+             counters.readings, counters.errors, counters.busyPolls, counters.maxCollectUs);
+}
@@ -0,0 +1,76 @@
+// Aht20 - AHT20 (the "DHT20") temperature/humidity sensor driven without blocking. trigger() starts a conversion
+// and returns straight away, collect() is called from loop() and only reads the result once the sensor is done
+// (~80 ms later), so nothing waits on the sensor the way Adafruit_AHTX0::getEvent() did
+//
+// Each reading carries the millis() time its conversion was started, so it can be sent later and still say
+// when it was measured
+
+#ifndef AHT20_H
+#define AHT20_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define AHT20_ADDRESS 0x38
+
+// how long a conversion takes according to the datasheet, collect() doesn't touch the bus before that
+#define AHT20_CONVERSION_MS 80
+
+// if it's still busy then, the status is read again this much later
+#define AHT20_BUSY_RETRY_MS 10
+
+// a conversion still busy this long after trigger() is given up on
+#define AHT20_TIMEOUT_MS 250
+
+// what collect() returns
+#define AHT20_IDLE    0  // no conversion started
+#define AHT20_WAITING 1  // conversion still running, try again on a later loop()
+#define AHT20_READY   2  // reading has been filled in
+#define AHT20_ERROR   3  // bus error, bad CRC or timeout (the conversion is dropped, trigger() again)
+
+typedef struct ClimateReading {
+  unsigned long takenMs = 0;  // millis() when the conversion started
+  float temperature = 0;      // degrees C
+  float humidity = 0;         // % rH
+} ClimateReading;
+
+// counters to check from the serial monitor how the sensor is doing
+typedef struct Aht20Stats {
+  unsigned long readings = 0;
+  unsigned long errors = 0;
+  unsigned long busyPolls = 0;    // collect() calls that read the status and found it still converting
+  unsigned long maxCollectUs = 0; // longest single collect(), i.e. the most time the sensor took out of loop()
+} Aht20Stats;
+
+class Aht20 {
+public:
+  Aht20(TwoWire &wire = Wire, uint8_t address = AHT20_ADDRESS) : wire(wire), address(address) {}
+
+  // checks the sensor is there and loads its calibration if it hasn't yet (only place that waits, ~10 ms)
+  bool begin();
+
+  // starts a conversion, false if one is still running or the sensor didn't answer
+  bool trigger();
+
+  // picks up the result of the conversion trigger() started, see AHT20_* for what it returns
+  int collect(ClimateReading &reading);
+
+  bool busy() const { return converting; }
+  const Aht20Stats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  bool command(uint8_t cmd, uint8_t arg0, uint8_t arg1);
+  int fail();
+
+  TwoWire &wire;
+  uint8_t address;
+
+  bool converting = false;
+  unsigned long triggeredMs = 0;
+  unsigned long waitMs = 0;  // how long after triggeredMs the next status read is due
+
+  Aht20Stats counters;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "ButtonEvents.h"
+
+int ButtonEvents::add(gpio_num_t pin) {
+  if (count == BUTTON_EVENTS_MAX_BUTTONS) {
+    return -1;
+  }
+
+  Button &button = buttons[count];
+  button.owner = this;
+  button.pin = pin;
+  button.index = count;
+  button.stableLevel = HIGH;
+  button.firstEdgeMs = 0;
+  button.timer = NULL;
+  pinMode(pin, INPUT_PULLUP);
+  return count++;
+}
+
+bool ButtonEvents::begin() {
+  ready = xSemaphoreCreateBinary();
+  if (ready == NULL) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    esp_timer_create_args_t args = {};
+    args.callback = onSettled;
+    args.arg = &buttons[i];
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "button";
+    if (esp_timer_create(&args, &buttons[i].timer) != ESP_OK) {
+      return false;
+    }
+    buttons[i].stableLevel = digitalRead(buttons[i].pin);
+    attachInterruptArg(buttons[i].pin, onEdge, &buttons[i], CHANGE);
+  }
+  return true;
+}
+
+void IRAM_ATTR ButtonEvents::onEdge(void *arg) {
+  Button *button = (Button *) arg;
+  button->owner->edgeCount.fetch_add(1, std::memory_order_relaxed);
+
+  // the first edge arms the timer, bounces after it fail with ESP_ERR_INVALID_STATE and are ignored
+  if (esp_timer_start_once(button->timer, BUTTON_DEBOUNCE_US) == ESP_OK) {
+    button->firstEdgeMs = millis();
+  }
+}
+
+void ButtonEvents::onSettled(void *arg) {
+  Button *button = (Button *) arg;
+  ButtonEvents *owner = button->owner;
+
+  int level = digitalRead(button->pin);
+  if (level == button->stableLevel) {
+    // bounced back to where it was (noise, or a press shorter than the debounce time)
+    return;
+  }
+  button->stableLevel = level;
+
+  // releases only matter for telling two presses apart, loop() just gets the presses
+  if (level == LOW) {
+    ButtonEvent event = { button->index, button->firstEdgeMs };
+    if (owner->events.push(event)) {
+      owner->presses++;
+      xSemaphoreGive(owner->ready);
+    }
+  }
+}
+
+bool ButtonEvents::wait(unsigned long timeoutMs) {
+  if (events.size() > 0) {
+    return true;
+  }
+  xSemaphoreTake(ready, pdMS_TO_TICKS(timeoutMs));
+  return events.size() > 0;
+}
+
+void ButtonEvents::printStats(Print &out) const {
+  out.printf("Buttons: %lu presses from %lu edges, %lu dropped\n", presses, edges(), dropped());
+}
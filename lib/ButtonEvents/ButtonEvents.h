@@ -0,0 +1,67 @@
+// ButtonEvents - button presses caught by GPIO interrupts instead of polling every pin on every loop().
+// An edge only arms a short one-shot timer; when it fires the pin has settled and is read once, so bounces
+// are filtered in milliseconds and a quick double press still counts twice. Presses are queued for loop(),
+// which can sleep on wait() in between instead of spinning
+
+#ifndef BUTTON_EVENTS_H
+#define BUTTON_EVENTS_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <SpscQueue.h>
+
+#define BUTTON_EVENTS_MAX_BUTTONS 8
+
+// how long a pin has to be left alone after an edge before it's read (contact bounce is over in a few ms)
+#define BUTTON_DEBOUNCE_US 20000
+
+typedef struct ButtonEvent {
+  uint8_t button;      // index returned by add()
+  uint32_t pressedMs;  // millis() when the first edge of the press came in
+} ButtonEvent;
+
+class ButtonEvents {
+public:
+  // registers an INPUT_PULLUP button (pressed = LOW), returns its index or -1 if the table is full
+  int add(gpio_num_t pin);
+
+  // creates the debounce timers and attaches the interrupts, call once after every add()
+  bool begin();
+
+  // loop() side: takes the oldest press off the queue
+  bool pop(ButtonEvent &event) { return events.pop(event); }
+
+  // blocks loop() until a press is queued or timeoutMs passes (returns true if one is waiting)
+  bool wait(unsigned long timeoutMs);
+
+  unsigned long edges() const { return edgeCount.load(std::memory_order_relaxed); }
+  unsigned long dropped() const { return events.dropped(); }
+  void printStats(Print &out) const;
+
+private:
+  typedef struct Button {
+    ButtonEvents *owner;
+    gpio_num_t pin;
+    uint8_t index;
+    int stableLevel;                     // level after the last settle (only touched by the timer callback)
+    std::atomic<uint32_t> firstEdgeMs;   // when the timer was armed
+    esp_timer_handle_t timer;
+  } Button;
+
+  static void IRAM_ATTR onEdge(void *arg);
+  static void onSettled(void *arg);
+
+  Button buttons[BUTTON_EVENTS_MAX_BUTTONS];
+  uint8_t count = 0;
+
+  // the timer callbacks all run in the esp_timer task, so there's one producer for the queue
+  SpscQueue<ButtonEvent, 16> events;
+  SemaphoreHandle_t ready = NULL;
+
+  std::atomic<unsigned long> edgeCount{0};  // raw interrupts, a lot more than presses when buttons bounce
+  unsigned long presses = 0;
+};
+
+#endif
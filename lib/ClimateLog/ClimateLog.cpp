@@ -0,0 +1,219 @@
+#include "ClimateLog.h"
+
+#define CLIMATE_LOG_PER_SECTOR (SPI_FLASH_SEC_SIZE / sizeof(ClimateRecord))
+
+// same CRC-8 as the AHT20 uses (polynomial 0x31, starts at 0xFF)
+static uint8_t crc8(const uint8_t *data, size_t len) {
+  uint8_t crc = 0xFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+bool ClimateLog::read(uint32_t slot, ClimateRecord &record) {
+  return esp_partition_read(partition, slot * sizeof(ClimateRecord), &record, sizeof(record)) == ESP_OK;
+}
+
+bool ClimateLog::blank(const ClimateRecord &record) const {
+  const uint8_t *bytes = (const uint8_t *) &record;
+  for (size_t i = 0; i < offsetof(ClimateRecord, acked); i++) {
+    if (bytes[i] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ClimateLog::valid(const ClimateRecord &record) const {
+  return !blank(record) && crc8((const uint8_t *) &record, offsetof(ClimateRecord, crc)) == record.crc;
+}
+
+bool ClimateLog::begin(const char *label) {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+  if (partition == NULL) {
+    return false;
+  }
+  uint32_t sectors = partition->size / SPI_FLASH_SEC_SIZE;
+  slots = sectors * CLIMATE_LOG_PER_SECTOR;
+
+  // the sector written last is the one whose first record is newest
+  ClimateRecord record;
+  int32_t newest = -1;
+  uint32_t newestSeq = 0;
+  for (uint32_t sector = 0; sector < sectors; sector++) {
+    for (uint32_t slot = sector * CLIMATE_LOG_PER_SECTOR; slot < (sector + 1) * CLIMATE_LOG_PER_SECTOR; slot++) {
+      if (!read(slot, record) || blank(record)) {
+        break;
+      }
+      if (valid(record)) {
+        if (newest < 0 || record.seq > newestSeq) {
+          newest = sector;
+          newestSeq = record.seq;
+        }
+        break;
+      }
+    }
+  }
+
+  if (newest < 0) {
+    // nothing written yet
+    head = 0;
+    tail = 0;
+    pending = 0;
+    nextSeq = 1;
+    bootId = 1;
+    return erase(0);
+  }
+
+  // writing continues at the first erased slot of that sector, or in the next sector if it's full
+  ClimateRecord last = {};
+  head = (newest + 1) * CLIMATE_LOG_PER_SECTOR % slots;
+  for (uint32_t slot = newest * CLIMATE_LOG_PER_SECTOR; slot < (newest + 1) * CLIMATE_LOG_PER_SECTOR; slot++) {
+    if (!read(slot, record)) {
+      return false;
+    }
+    if (blank(record)) {
+      head = slot;
+      break;
+    }
+    if (valid(record)) {
+      last = record;
+    }
+  }
+  nextSeq = last.seq + 1;
+  bootId = last.boot + 1;
+
+  // sending picks up after the newest acked record: walk back from head as long as the records are unacked and
+  // their sequence numbers count down without a gap (a gap means the older round of the ring was reached)
+  tail = head;
+  uint32_t expected = last.seq;
+  uint32_t slot = head;
+  for (uint32_t walked = 0; walked < slots; walked++) {
+    slot = (slot + slots - 1) % slots;
+    if (!read(slot, record) || blank(record)) {
+      break;
+    }
+    if (!valid(record)) {
+      counters.corrupt++;
+      continue;
+    }
+    if (record.seq != expected || record.acked == 0) {
+      break;
+    }
+    tail = slot;
+    expected--;
+  }
+  pending = (head + slots - tail) % slots;
+
+  // head always points at an erased slot, see append()
+  return head % CLIMATE_LOG_PER_SECTOR != 0 || erase(head / CLIMATE_LOG_PER_SECTOR);
+}
+
+// erases the sector head is about to write into. Unsent records still in it are lost, sending skips to the
+// oldest sector that's left
+bool ClimateLog::erase(uint32_t sector) {
+  if (pending > 0 && tail / CLIMATE_LOG_PER_SECTOR == sector) {
+    uint32_t nextSector = (sector + 1) * CLIMATE_LOG_PER_SECTOR % slots;
+    uint32_t lost = (nextSector + slots - tail) % slots;
+    counters.overwritten += lost;
+    pending -= lost;
+    tail = nextSector;
+  }
+  counters.erases++;
+  return esp_partition_erase_range(partition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE) == ESP_OK;
+}
+
+bool ClimateLog::append(const ClimateReading &reading) {
+  if (partition == NULL) {
+    return false;
+  }
+
+  ClimateRecord record;
+  record.seq = nextSeq;
+  record.takenMs = reading.takenMs;
+  record.boot = bootId;
+  record.centiC = (int16_t) lroundf(reading.temperature * 100);
+  record.centiRH = (uint16_t) lroundf(reading.humidity * 100);
+  record.crc = crc8((const uint8_t *) &record, offsetof(ClimateRecord, crc));
+  record.acked = 0xFF;
+
+  if (esp_partition_write(partition, head * sizeof(ClimateRecord), &record, sizeof(record)) != ESP_OK) {
+    return false;
+  }
+  nextSeq++;
+  pending++;
+  counters.appended++;
+
+  // erase the next sector as soon as this one is full, so head always points at an erased slot
+  head = next(head);
+  return head % CLIMATE_LOG_PER_SECTOR != 0 || erase(head / CLIMATE_LOG_PER_SECTOR);
+}
+
+size_t ClimateLog::peek(ClimateRecord *out, size_t max) {
+  size_t count = 0;
+  uint32_t slot = tail;
+  for (uint32_t i = 0; i < pending && count < max; i++, slot = next(slot)) {
+    if (read(slot, out[count]) && valid(out[count])) {
+      count++;
+    }
+  }
+  return count;
+}
+
+bool ClimateLog::ack(uint32_t lastSeq) {
+  ClimateRecord record;
+  int32_t lastSlot = -1;
+  while (pending > 0) {
+    if (read(tail, record) && valid(record)) {
+      if (record.seq > lastSeq) {
+        break;
+      }
+      lastSlot = tail;
+      counters.acked++;
+    }
+    tail = next(tail);
+    pending--;
+  }
+
+  if (lastSlot < 0) {
+    return true;
+  }
+  // clearing bits of a written byte works without an erase
+  uint8_t acked = 0;
+  return esp_partition_write(partition, lastSlot * sizeof(ClimateRecord) + offsetof(ClimateRecord, acked),
+                             &acked, 1) == ESP_OK;
+}
+
+void ClimateLog::printStats(Print &out) const {
+  out.printf("Log: %lu unsent, %lu appended, %lu acked, %lu overwritten, %lu erases, %lu corrupt (boot %u)\n",
+             (unsigned long) unsent(), counters.appended, counters.acked, counters.overwritten, counters.erases,
+             counters.corrupt, bootId);
+}
+
+size_t formatReadings(const ClimateRecord *records, size_t count, uint16_t boot, unsigned long now, char *out,
+                      size_t outSize, size_t &written) {
+  size_t len = 0;
+  written = 0;
+  for (size_t i = 0; i < count; i++) {
+    const ClimateRecord &record = records[i];
+    char age[12] = "";
+    if (record.boot == boot) {
+      snprintf(age, sizeof(age), "%lu", now - record.takenMs);
+    }
+
+    int n = snprintf(out + len, outSize - len, "%lu,%u,%s,%.2f,%.2f\n", (unsigned long) record.seq, record.boot,
+                     age, record.centiC / 100.0, record.centiRH / 100.0);
+    if (n < 0 || (size_t) n >= outSize - len) {
+      // the line got cut off, the body ends with the one before it
+      out[len] = '\0';
+      break;
+    }
+    len += n;
+    written++;
+  }
+  return len;
+}
@@ -0,0 +1,88 @@
+// ClimateLog - store-and-forward log of climate readings in a raw flash partition, so readings taken while the
+// server or WiFi is unreachable (or before a reboot) are kept and sent later, in order
+//
+// The partition is a ring of fixed size 16 byte records written strictly one after another; a sector is only
+// erased when the ring comes back round to it, so every sector wears at the same slow rate. When the server has
+// a batch, the last record of it gets its acked byte cleared in place (clearing bits needs no erase), which is
+// all it takes to remember after a reboot where sending has to pick up
+
+#ifndef CLIMATE_LOG_H
+#define CLIMATE_LOG_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <Aht20.h>
+
+typedef struct __attribute__((packed)) ClimateRecord {
+  uint32_t seq;        // 1, 2, 3, ... over the whole life of the log
+  uint32_t takenMs;    // millis() when it was measured, only means something during the same boot
+  uint16_t boot;       // which boot it was measured in (see ClimateLog::boot())
+  int16_t centiC;      // temperature in 0.01 C
+  uint16_t centiRH;    // humidity in 0.01 % rH
+  uint8_t crc;         // CRC-8 of the bytes above, a record torn by a power cut doesn't pass
+  uint8_t acked;       // 0xFF, cleared to 0 once the server has this record and every one before it
+} ClimateRecord;
+
+static_assert(sizeof(ClimateRecord) == 16, "ClimateRecord has to stay 16 bytes (256 per flash sector)");
+
+// counters to check from the serial monitor
+typedef struct ClimateLogStats {
+  unsigned long appended = 0;
+  unsigned long acked = 0;
+  unsigned long overwritten = 0;  // unsent records lost because the ring came round to them
+  unsigned long erases = 0;       // sectors erased since boot
+  unsigned long corrupt = 0;      // records skipped because their CRC didn't match
+} ClimateLogStats;
+
+class ClimateLog {
+public:
+  // finds the partition (by default the "spiffs" data partition of the standard partition table, which
+  // Lab 3 doesn't use for a file system) and scans it for where writing and sending left off
+  bool begin(const char *label = "spiffs");
+
+  // appends a reading, false if the flash write failed
+  bool append(const ClimateReading &reading);
+
+  // copies up to max of the oldest unsent records into out without taking them off the log, returns how many
+  size_t peek(ClimateRecord *out, size_t max);
+
+  // the server has everything up to and including record lastSeq (the last one a peek() returned)
+  bool ack(uint32_t lastSeq);
+
+  // records appended but not acked yet
+  uint32_t unsent() const { return pending; }
+
+  uint16_t boot() const { return bootId; }
+  const ClimateLogStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  bool read(uint32_t slot, ClimateRecord &record);
+  bool valid(const ClimateRecord &record) const;
+  bool blank(const ClimateRecord &record) const;
+  uint32_t next(uint32_t slot) const { return (slot + 1) % slots; }
+  bool erase(uint32_t sector);
+
+  const esp_partition_t *partition = NULL;
+  uint32_t slots = 0;       // records the partition holds
+  uint32_t head = 0;        // slot the next record goes into
+  uint32_t tail = 0;        // oldest unsent slot
+  uint32_t pending = 0;     // slots from tail to head (head == tail can mean empty or full, this tells them apart)
+  uint32_t nextSeq = 1;
+  uint16_t bootId = 0;
+
+  ClimateLogStats counters;
+};
+
+// longest line formatReadings writes (10 digit seq, 5 digit boot, 10 digit age, -327.68, 655.35, separators)
+#define CLIMATE_LINE_MAX 44
+
+// writes records as the batch body Lab 3's server takes, one line each:
+// "<seq>,<boot>,<age ms>,<temperature>,<humidity>\n", where age is how long ago (at now) the reading was taken
+// and is left empty for readings from a boot other than boot (their takenMs means nothing now)
+// stops before the first line that doesn't fit into out, returns the body length and sets written to how many
+// records went into it
+size_t formatReadings(const ClimateRecord *records, size_t count, uint16_t boot, unsigned long now, char *out,
+                      size_t outSize, size_t &written);
+
+#endif
@@ -0,0 +1,198 @@
+#include "Lsm6dsoFifo.h"
+
+// registers and values from the LSM6DSO datasheet
+#define LSM6DSO_FIFO_CTRL1   0x07  // watermark, low 8 bits
+#define LSM6DSO_FIFO_CTRL2   0x08  // watermark bit 8
+#define LSM6DSO_FIFO_CTRL3   0x09  // batch data rates, accelerometer in the low nibble
+#define LSM6DSO_FIFO_CTRL4   0x0A  // FIFO mode
+#define LSM6DSO_INT1_CTRL    0x0D
+#define LSM6DSO_WHO_AM_I     0x0F
+#define LSM6DSO_CTRL1_XL     0x10
+#define LSM6DSO_CTRL3_C      0x12
+#define LSM6DSO_FIFO_STATUS1 0x3A
+#define LSM6DSO_FIFO_TAG     0x78  // tag byte then X/Y/Z, the address rolls back here after Z so words read back to back
+
+#define LSM6DSO_ID             0x6C
+#define LSM6DSO_SW_RESET       0x01
+#define LSM6DSO_BDU_IF_INC     0x44  // block data update, auto-increment for burst reads
+#define LSM6DSO_XL_104HZ_8G    0x4C
+#define LSM6DSO_BDR_XL_104HZ   0x04
+#define LSM6DSO_FIFO_BYPASS    0x00  // also empties it
+#define LSM6DSO_FIFO_STREAM    0x06  // continuous, the oldest sample is overwritten when full
+#define LSM6DSO_INT1_FIFO_TH   0x08
+#define LSM6DSO_FIFO_OVR_LATCHED 0x08  // FIFO_STATUS2, cleared by reading it
+#define LSM6DSO_TAG_XL         0x02
+
+// how long the FIFO takes to reach the watermark, and how long read() waits for INT1 before it polls anyway
+#define LSM6DSO_WATERMARK_MS (LSM6DSO_WATERMARK * 1000 / LSM6DSO_ODR_HZ)
+
+// bits on the bus for a register write and for a register read of len bytes (start, address + register,
+// repeated start, address, data, stop; every byte is 8 bits and an ACK)
+#define I2C_WRITE_BITS 29
+#define I2C_READ_BITS(len) (30 + 9 * (unsigned long) (len))
+
+bool Lsm6dsoFifo::writeRegister(uint8_t reg, uint8_t value) {
+  counters.transactions++;
+  counters.busBits += I2C_WRITE_BITS;
+  wire.beginTransmission(address);
+  wire.write(reg);
+  wire.write(value);
+  if (wire.endTransmission() != 0) {
+    counters.errors++;
+    return false;
+  }
+  return true;
+}
+
+bool Lsm6dsoFifo::readRegisters(uint8_t reg, uint8_t *data, uint8_t len) {
+  counters.transactions++;
+  counters.busBits += I2C_READ_BITS(len);
+  wire.beginTransmission(address);
+  wire.write(reg);
+  if (wire.endTransmission(false) != 0 || wire.requestFrom(address, len) != len) {
+    counters.errors++;
+    return false;
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    data[i] = wire.read();
+  }
+  return true;
+}
+
+bool Lsm6dsoFifo::begin(int interruptPin) {
+  wire.begin();
+  wire.setClock(LSM6DSO_I2C_HZ);
+
+  uint8_t id;
+  if (!readRegisters(LSM6DSO_WHO_AM_I, &id, 1) || id != LSM6DSO_ID) {
+    return false;
+  }
+
+  // back to the power-on settings, the reset bit clears itself once it's done (~50 us)
+  if (!writeRegister(LSM6DSO_CTRL3_C, LSM6DSO_SW_RESET)) {
+    return false;
+  }
+  uint8_t ctrl3 = LSM6DSO_SW_RESET;
+  for (int i = 0; i < 10 && (ctrl3 & LSM6DSO_SW_RESET); i++) {
+    delay(1);
+    readRegisters(LSM6DSO_CTRL3_C, &ctrl3, 1);
+  }
+
+  if (!writeRegister(LSM6DSO_CTRL3_C, LSM6DSO_BDU_IF_INC) ||
+      !writeRegister(LSM6DSO_CTRL1_XL, LSM6DSO_XL_104HZ_8G) ||
+      !writeRegister(LSM6DSO_FIFO_CTRL1, LSM6DSO_WATERMARK & 0xFF) ||
+      !writeRegister(LSM6DSO_FIFO_CTRL2, (LSM6DSO_WATERMARK >> 8) & 0x01) ||
+      !writeRegister(LSM6DSO_FIFO_CTRL3, LSM6DSO_BDR_XL_104HZ) ||
+      !writeRegister(LSM6DSO_INT1_CTRL, LSM6DSO_INT1_FIFO_TH)) {
+    return false;
+  }
+
+  // INT1 is push-pull, active high, and stays high while the FIFO is at or above the watermark
+  this->interruptPin = interruptPin;
+  if (interruptPin >= 0) {
+    pinMode(interruptPin, INPUT);
+    attachInterruptArg(interruptPin, onWatermark, this, RISING);
+  }
+  return restart();
+}
+
+bool Lsm6dsoFifo::restart() {
+  if (!writeRegister(LSM6DSO_FIFO_CTRL4, LSM6DSO_FIFO_BYPASS) ||
+      !writeRegister(LSM6DSO_FIFO_CTRL4, LSM6DSO_FIFO_STREAM)) {
+    return false;
+  }
+  counters = Lsm6dsoStats();
+  nextIndex = 0;
+  watermark = false;
+  startedMs = millis();
+  lastDrainMs = startedMs;
+  return true;
+}
+
+void IRAM_ATTR Lsm6dsoFifo::onWatermark(void *arg) {
+  ((Lsm6dsoFifo *) arg)->watermark = true;
+}
+
+bool Lsm6dsoFifo::ready() const {
+  unsigned long pollMs = interruptPin >= 0 ? 2 * LSM6DSO_WATERMARK_MS : LSM6DSO_WATERMARK_MS;
+  return watermark || millis() - lastDrainMs >= pollMs;
+}
+
+// how many samples the FIFO holds, counting the ones lost if it overran since the last look
+bool Lsm6dsoFifo::waiting(uint16_t &words) {
+  uint8_t status[2];
+  if (!readRegisters(LSM6DSO_FIFO_STATUS1, status, sizeof(status))) {
+    return false;
+  }
+  words = ((status[1] & 0x03) << 8) | status[0];
+
+  if (status[1] & LSM6DSO_FIFO_OVR_LATCHED) {
+    // the oldest samples were overwritten, skip their indexes (going by the time since the last drain) so the
+    // index still gives the right time for the ones that are left
+    counters.overruns++;
+    unsigned long due = (millis() - lastDrainMs) * LSM6DSO_ODR_HZ / 1000;
+    if (due > words) {
+      nextIndex += due - words;
+    }
+  }
+  return true;
+}
+
+size_t Lsm6dsoFifo::read(ImuSample *out, size_t maxSamples) {
+  unsigned long start = micros();
+  if (watermark) {
+    watermark = false;
+    counters.interrupts++;
+  } else if (millis() - lastDrainMs >= LSM6DSO_WATERMARK_MS) {
+    counters.polls++;
+  }
+
+  uint16_t words;
+  if (!waiting(words)) {
+    return 0;
+  }
+
+  size_t count = 0;
+  uint8_t burst[LSM6DSO_BURST_WORDS * LSM6DSO_WORD_BYTES];
+  while (words > 0 && count < maxSamples) {
+    uint8_t n = min((size_t) min(words, (uint16_t) LSM6DSO_BURST_WORDS), maxSamples - count);
+    if (!readRegisters(LSM6DSO_FIFO_TAG, burst, n * LSM6DSO_WORD_BYTES)) {
+      break;
+    }
+    words -= n;
+
+    for (uint8_t i = 0; i < n; i++) {
+      const uint8_t *word = burst + i * LSM6DSO_WORD_BYTES;
+      if ((word[0] >> 3) != LSM6DSO_TAG_XL) {
+        // only the accelerometer is batched, anything else means the read got out of step
+        counters.errors++;
+        continue;
+      }
+      ImuSample &sample = out[count++];
+      sample.index = nextIndex++;
+      sample.x = (int16_t) (word[1] | (word[2] << 8));
+      sample.y = (int16_t) (word[3] | (word[4] << 8));
+      sample.z = (int16_t) (word[5] | (word[6] << 8));
+#ifdef LSM6DSO_PRINT_SAMPLES
+      // build with -DLSM6DSO_PRINT_SAMPLES to record a trace from the serial monitor (see native/step_replay.cpp)
+      Serial.printf("imu,%lu,%d,%d,%d\n", (unsigned long) sample.index, sample.x, sample.y, sample.z);
+#endif
+    }
+  }
+
+  lastDrainMs = millis();
+  counters.samples += count;
+  counters.maxDrainUs = max(counters.maxDrainUs, micros() - start);
+  return count;
+}
+
+void Lsm6dsoFifo::printStats(Print &out) const {
+  unsigned long elapsedMs = max(millis() - startedMs, 1UL);
+  out.printf("LSM6DSO: %lu samples in %lu ms (%.1f Hz), %lu interrupts, %lu polls, %lu overruns, %lu errors, "
+             "longest read %lu us\n",
+             counters.samples, elapsedMs, counters.samples * 1000.0f / elapsedMs, counters.interrupts,
+             counters.polls, counters.overruns, counters.errors, counters.maxDrainUs);
+  out.printf("I2C: %lu transactions, %.1f bits per sample, bus %.2f%% busy at %d kHz\n", counters.transactions,
+             counters.samples > 0 ? (float) counters.busBits / counters.samples : 0.0f,
+             counters.busBits * 100.0f / ((float) LSM6DSO_I2C_HZ * elapsedMs / 1000), LSM6DSO_I2C_HZ / 1000);
+}
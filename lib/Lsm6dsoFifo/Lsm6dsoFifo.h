@@ -0,0 +1,94 @@
+// Lsm6dsoFifo - LSM6DSO accelerometer sampled by the sensor itself at a fixed output data rate into its FIFO,
+// instead of loop() asking for one reading every delay(100). The FIFO raises INT1 once it holds a watermark's
+// worth of samples and loop() drains it with burst reads, so the step detector gets every sample, evenly spaced
+// at LSM6DSO_ODR_HZ, however long loop() was busy with something else (the FIFO holds over 4 s)
+//
+// One burst reads up to LSM6DSO_BURST_WORDS samples in a single I2C transaction, where readFloatAccelX/Y/Z()
+// took three transactions for one sample
+
+#ifndef LSM6DSO_FIFO_H
+#define LSM6DSO_FIFO_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define LSM6DSO_ADDRESS 0x6B  // SA0 high, as on the SparkFun Qwiic board
+
+// the rate the accelerometer is sampled at (and batched into the FIFO), a foot strike lasts ~50-100 ms
+#define LSM6DSO_ODR_HZ 104
+
+// +/- 8 g full scale, a jump landing goes well past 4 g
+#define LSM6DSO_G_PER_LSB 0.000244f
+
+// each FIFO word is a tag byte and one X/Y/Z sample, a burst is as many words as the Wire buffer holds
+#define LSM6DSO_WORD_BYTES 7
+#define LSM6DSO_BURST_WORDS (I2C_BUFFER_LENGTH / LSM6DSO_WORD_BYTES)
+
+// INT1 goes high once this many samples are waiting (18 at 104 Hz = every ~173 ms, one burst each time)
+#define LSM6DSO_WATERMARK LSM6DSO_BURST_WORDS
+
+#define LSM6DSO_I2C_HZ 400000
+
+// one accelerometer sample, raw counts (multiply by LSM6DSO_G_PER_LSB for g)
+typedef struct ImuSample {
+  uint32_t index;  // samples since begin()/restart(), so the time of a sample is index / LSM6DSO_ODR_HZ
+  int16_t x;
+  int16_t y;
+  int16_t z;
+} ImuSample;
+
+// counters to check from the serial monitor how the sampling is doing
+typedef struct Lsm6dsoStats {
+  unsigned long samples = 0;
+  unsigned long interrupts = 0;  // watermark interrupts taken
+  unsigned long polls = 0;       // drains started without one (INT1 not wired, or an edge was missed)
+  unsigned long transactions = 0;
+  unsigned long busBits = 0;     // bits clocked on the bus for all of them, for the utilization
+  unsigned long overruns = 0;    // the FIFO filled up and samples were lost before they were drained
+  unsigned long errors = 0;      // bus errors and FIFO words that weren't accelerometer data
+  unsigned long maxDrainUs = 0;  // longest single read(), i.e. the most time the sensor took out of loop()
+} Lsm6dsoStats;
+
+class Lsm6dsoFifo {
+public:
+  Lsm6dsoFifo(TwoWire &wire = Wire, uint8_t address = LSM6DSO_ADDRESS) : wire(wire), address(address) {}
+
+  // resets the sensor, sets the rate and range and starts the FIFO. With interruptPin < 0 (INT1 not wired)
+  // read() just polls every watermark period
+  bool begin(int interruptPin = -1);
+
+  // empties the FIFO and starts the sample count again, for after a stretch where nobody was reading
+  bool restart();
+
+  // true when the watermark interrupt fired or a poll is due, read() is worth calling
+  bool ready() const;
+
+  // takes up to maxSamples (oldest first) off the FIFO in as few bursts as it can, returns how many. Keep
+  // calling until it returns less than maxSamples to leave the FIFO below the watermark so INT1 can rise again
+  size_t read(ImuSample *out, size_t maxSamples);
+
+  static float toG(int16_t raw) { return raw * LSM6DSO_G_PER_LSB; }
+
+  const Lsm6dsoStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  bool writeRegister(uint8_t reg, uint8_t value);
+  bool readRegisters(uint8_t reg, uint8_t *data, uint8_t len);
+  bool waiting(uint16_t &words);
+
+  static void IRAM_ATTR onWatermark(void *arg);
+
+  TwoWire &wire;
+  uint8_t address;
+  int interruptPin = -1;
+
+  volatile bool watermark = false;
+  unsigned long lastDrainMs = 0;
+  unsigned long startedMs = 0;
+  uint32_t nextIndex = 0;
+
+  Lsm6dsoStats counters;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "Lsm6dsoPedometer.h"
+
+// registers and values from the LSM6DSO datasheet and AN5192 (embedded functions)
+#define LSM6DSO_FUNC_CFG_ACCESS 0x01  // bit 7 switches the addresses below 0x80 to the embedded function bank
+#define LSM6DSO_WHO_AM_I        0x0F
+#define LSM6DSO_CTRL1_XL        0x10
+#define LSM6DSO_CTRL3_C         0x12
+#define LSM6DSO_EMB_FUNC_STATUS_MAINPAGE 0x35  // reading it clears the latched step interrupt
+#define LSM6DSO_MD1_CFG         0x5E
+
+// embedded function bank
+#define LSM6DSO_EMB_FUNC_EN_A   0x04
+#define LSM6DSO_EMB_FUNC_INT1   0x0A
+#define LSM6DSO_PAGE_RW         0x17
+#define LSM6DSO_STEP_COUNTER_L  0x62
+#define LSM6DSO_EMB_FUNC_SRC    0x64
+
+#define LSM6DSO_ID              0x6C
+#define LSM6DSO_SW_RESET        0x01
+#define LSM6DSO_BDU_IF_INC      0x44
+#define LSM6DSO_EMB_FUNC_BANK   0x80
+#define LSM6DSO_PEDO_EN         0x08
+#define LSM6DSO_INT1_STEP_DETECTOR 0x08
+#define LSM6DSO_EMB_FUNC_LIR    0x80  // latched embedded function interrupts
+#define LSM6DSO_PEDO_RST_STEP   0x80
+#define LSM6DSO_INT1_EMB_FUNC   0x02
+#define LSM6DSO_XL_26HZ_4G      0x28
+
+bool Lsm6dsoPedometer::writeRegister(uint8_t reg, uint8_t value) {
+  wire.beginTransmission(address);
+  wire.write(reg);
+  wire.write(value);
+  if (wire.endTransmission() != 0) {
+    counters.errors++;
+    return false;
+  }
+  return true;
+}
+
+bool Lsm6dsoPedometer::readRegisters(uint8_t reg, uint8_t *data, uint8_t len) {
+  wire.beginTransmission(address);
+  wire.write(reg);
+  if (wire.endTransmission(false) != 0 || wire.requestFrom(address, len) != len) {
+    counters.errors++;
+    return false;
+  }
+  for (uint8_t i = 0; i < len; i++) {
+    data[i] = wire.read();
+  }
+  return true;
+}
+
+bool Lsm6dsoPedometer::begin(int interruptPin) {
+  wire.begin();
+  wire.setClock(LSM6DSO_I2C_HZ);
+
+  uint8_t id;
+  if (!readRegisters(LSM6DSO_WHO_AM_I, &id, 1) || id != LSM6DSO_ID) {
+    return false;
+  }
+
+  if (!writeRegister(LSM6DSO_CTRL3_C, LSM6DSO_SW_RESET)) {
+    return false;
+  }
+  uint8_t ctrl3 = LSM6DSO_SW_RESET;
+  for (int i = 0; i < 10 && (ctrl3 & LSM6DSO_SW_RESET); i++) {
+    delay(1);
+    readRegisters(LSM6DSO_CTRL3_C, &ctrl3, 1);
+  }
+
+  // the pedometer, its step interrupt (latched) and a zeroed count are set up in the embedded function bank,
+  // then back to the normal registers to route it to INT1 and start the accelerometer
+  if (!writeRegister(LSM6DSO_CTRL3_C, LSM6DSO_BDU_IF_INC) ||
+      !writeRegister(LSM6DSO_FUNC_CFG_ACCESS, LSM6DSO_EMB_FUNC_BANK) ||
+      !writeRegister(LSM6DSO_EMB_FUNC_EN_A, LSM6DSO_PEDO_EN) ||
+      !writeRegister(LSM6DSO_EMB_FUNC_INT1, LSM6DSO_INT1_STEP_DETECTOR) ||
+      !writeRegister(LSM6DSO_PAGE_RW, LSM6DSO_EMB_FUNC_LIR) ||
+      !writeRegister(LSM6DSO_EMB_FUNC_SRC, LSM6DSO_PEDO_RST_STEP) ||
+      !writeRegister(LSM6DSO_FUNC_CFG_ACCESS, 0) ||
+      !writeRegister(LSM6DSO_MD1_CFG, LSM6DSO_INT1_EMB_FUNC) ||
+      !writeRegister(LSM6DSO_CTRL1_XL, LSM6DSO_XL_26HZ_4G)) {
+    return false;
+  }
+
+  this->interruptPin = interruptPin;
+  counters = Lsm6dsoPedometerStats();
+  if (interruptPin >= 0) {
+    if (stepped == NULL) {
+      stepped = xSemaphoreCreateBinary();
+    }
+    xSemaphoreTake(stepped, 0);
+    pinMode(interruptPin, INPUT);
+    attachInterruptArg(interruptPin, onStep, this, RISING);
+  }
+  return true;
+}
+
+void IRAM_ATTR Lsm6dsoPedometer::onStep(void *arg) {
+  Lsm6dsoPedometer *pedometer = (Lsm6dsoPedometer *) arg;
+  pedometer->counters.interrupts++;
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(pedometer->stepped, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+bool Lsm6dsoPedometer::wait(unsigned long timeoutMs) {
+  if (interruptPin < 0) {
+    delay(timeoutMs);
+    return false;
+  }
+  return xSemaphoreTake(stepped, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+bool Lsm6dsoPedometer::steps(uint16_t &count) {
+  uint8_t status;
+  uint8_t data[2];
+  if (!readRegisters(LSM6DSO_EMB_FUNC_STATUS_MAINPAGE, &status, 1) ||
+      !writeRegister(LSM6DSO_FUNC_CFG_ACCESS, LSM6DSO_EMB_FUNC_BANK)) {
+    return false;
+  }
+  bool read = readRegisters(LSM6DSO_STEP_COUNTER_L, data, sizeof(data));
+  if (!writeRegister(LSM6DSO_FUNC_CFG_ACCESS, 0) || !read) {
+    return false;
+  }
+  counters.reads++;
+  count = data[0] | (data[1] << 8);
+  return true;
+}
+
+void Lsm6dsoPedometer::printStats(Print &out) const {
+  out.printf("LSM6DSO pedometer: %lu step interrupts, %lu counts read, %lu errors\n", counters.interrupts,
+             counters.reads, counters.errors);
+}
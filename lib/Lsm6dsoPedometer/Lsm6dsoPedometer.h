@@ -0,0 +1,62 @@
+// Lsm6dsoPedometer - steps counted by the LSM6DSO itself. Its embedded pedometer runs on the accelerometer at
+// LSM6DSO_PEDO_ODR_HZ, keeps a 16 bit step count and raises INT1 on every step, so the ESP32 has nothing to do
+// between steps and can sleep: one wake-up and one short I2C read per step, where counting in software drains
+// the FIFO ~6 times a second whether anyone is walking or not
+//
+// The interrupt is latched, INT1 stays high until steps() reads it, so a level wake-up (light sleep) can't miss
+// one. The sensor holds back the count until it has seen a few steps in a row (its debounce, PEDO_DEB_STEPS_CONF,
+// 10 by default), after which they're all added at once. Only one of this and Lsm6dsoFifo runs at a time,
+// begin() on either resets the sensor for its own use
+
+#ifndef LSM6DSO_PEDOMETER_H
+#define LSM6DSO_PEDOMETER_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Lsm6dsoFifo.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// the slowest rate the pedometer works at, and the least current
+#define LSM6DSO_PEDO_ODR_HZ 26
+
+// counters to check from the serial monitor how the pedometer is doing
+typedef struct Lsm6dsoPedometerStats {
+  unsigned long interrupts = 0;  // step interrupts taken (only with INT1 attached)
+  unsigned long reads = 0;       // step counts read
+  unsigned long errors = 0;      // bus errors
+} Lsm6dsoPedometerStats;
+
+class Lsm6dsoPedometer {
+public:
+  Lsm6dsoPedometer(TwoWire &wire = Wire, uint8_t address = LSM6DSO_ADDRESS) : wire(wire), address(address) {}
+
+  // resets the sensor, starts the pedometer from 0 steps and routes its step interrupt to INT1. With
+  // interruptPin >= 0 an interrupt handler is attached for wait(), leave it at -1 when something else watches the
+  // pin (a light sleep wake-up source)
+  bool begin(int interruptPin = -1);
+
+  // blocks until a step interrupt or timeoutMs, true for a step. Without an interrupt pin it only waits
+  bool wait(unsigned long timeoutMs);
+
+  // the sensor's step count (wraps at 65535) and clears the latched interrupt
+  bool steps(uint16_t &count);
+
+  const Lsm6dsoPedometerStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  bool writeRegister(uint8_t reg, uint8_t value);
+  bool readRegisters(uint8_t reg, uint8_t *data, uint8_t len);
+
+  static void IRAM_ATTR onStep(void *arg);
+
+  TwoWire &wire;
+  uint8_t address;
+  int interruptPin = -1;
+  SemaphoreHandle_t stepped = NULL;
+
+  Lsm6dsoPedometerStats counters;
+};
+
+#endif
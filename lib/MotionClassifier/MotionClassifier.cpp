@@ -0,0 +1,167 @@
+#include "MotionClassifier.h"
+
+#define MOTION_GRAVITY_SAMPLES (MOTION_GRAVITY_TAU_S * LSM6DSO_ODR_HZ)
+#define MOTION_SAMPLES(ms) ((ms) * LSM6DSO_ODR_HZ / 1000)
+
+void MotionClassifier::reset() {
+  gravityX = 0;
+  gravityY = 0;
+  gravityZ = 0;
+  seen = 0;
+  current = MOTION_GROUND;
+  jumpFrom = 0;
+  jumpTo = 0;
+  pendingCount = 0;
+  counters = MotionClassifierStats();
+}
+
+bool MotionClassifier::inJump(uint32_t index) const {
+  return index >= jumpFrom && index < jumpTo;
+}
+
+// a footfall waits in pending until release() knows it isn't part of a jump
+void MotionClassifier::hold(const StepEvent &footfall, MotionEvent *events, size_t &count) {
+  if (inJump(footfall.index)) {
+    counters.absorbed++;
+    return;
+  }
+  if (pendingCount == MOTION_MAX_PENDING) {
+    // more footfalls than a take off can have, the oldest was a step
+    release(pending[0].index + 1, events, count);
+  }
+  pending[pendingCount++] = footfall;
+}
+
+// the held footfalls that started before this sample are steps
+void MotionClassifier::release(uint32_t before, MotionEvent *events, size_t &count) {
+  size_t kept = 0;
+  for (size_t i = 0; i < pendingCount; i++) {
+    if (pending[i].index < before) {
+      events[count].kind = MOTION_STEP;
+      events[count].index = pending[i].index;
+      events[count].airtime = 0;
+      count++;
+      counters.steps++;
+    } else {
+      pending[kept++] = pending[i];
+    }
+  }
+  pendingCount = kept;
+}
+
+// the jump state machine, one sample of vertical acceleration at a time
+void MotionClassifier::step(uint32_t index, float vertical, MotionEvent *events, size_t &count) {
+  switch (current) {
+    case MOTION_GROUND:
+      if (vertical > MOTION_PUSH_G) {
+        current = MOTION_TAKEOFF;
+        takeoffIndex = index;
+      }
+      break;
+
+    case MOTION_TAKEOFF:
+      if (vertical < -MOTION_FLIGHT_G) {
+        current = MOTION_FLIGHT;
+        flightIndex = index;
+      } else if (index - takeoffIndex > MOTION_SAMPLES(MOTION_MAX_TAKEOFF_MS)) {
+        // a heel strike or a stomp, its footfall is a step
+        current = MOTION_GROUND;
+        counters.pushes++;
+      }
+      break;
+
+    case MOTION_FLIGHT:
+      if (index - flightIndex > MOTION_SAMPLES(MOTION_MAX_FLIGHT_MS)) {
+        // nobody's in the air that long, the board was dropped or thrown
+        current = MOTION_GROUND;
+        counters.hops++;
+      } else if (vertical >= -MOTION_FLIGHT_G) {
+        if (index - flightIndex >= MOTION_SAMPLES(MOTION_MIN_FLIGHT_MS)) {
+          current = MOTION_LANDING;
+          landingIndex = index;
+          airtime = (index - flightIndex) / (float) LSM6DSO_ODR_HZ;
+        } else {
+          current = MOTION_GROUND;
+          counters.hops++;
+        }
+      }
+      break;
+
+    case MOTION_LANDING:
+      if (vertical > MOTION_LANDING_G) {
+        // steps before the push off go out first, the footfalls from it on were the jump
+        uint32_t from = takeoffIndex - min(takeoffIndex, (uint32_t) MOTION_SAMPLES(MOTION_TAKEOFF_LEAD_MS));
+        release(from, events, count);
+        counters.absorbed += pendingCount;
+        pendingCount = 0;
+        jumpFrom = from;
+        jumpTo = index + MOTION_SAMPLES(MOTION_SETTLE_MS);
+
+        events[count].kind = MOTION_JUMP;
+        events[count].index = takeoffIndex;
+        events[count].airtime = airtime;
+        count++;
+        counters.jumps++;
+        current = MOTION_GROUND;
+      } else if (index - landingIndex > MOTION_SAMPLES(MOTION_MAX_LANDING_MS)) {
+        current = MOTION_GROUND;
+        counters.softLandings++;
+      }
+      break;
+  }
+}
+
+size_t MotionClassifier::feed(const ImuSample *samples, size_t n, const StepEvent *footfalls, size_t found,
+                              MotionEvent *events) {
+  size_t count = 0;
+  for (size_t i = 0; i < found; i++) {
+    hold(footfalls[i], events, count);
+  }
+
+  // gravity moves slowly enough to take its direction once per block (18 samples, ~170 ms)
+  float magnitude = gravity();
+  float upX = 0, upY = 0, upZ = 0;
+  if (magnitude > 0) {
+    upX = gravityX / magnitude;
+    upY = gravityY / magnitude;
+    upZ = gravityZ / magnitude;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    const ImuSample &sample = samples[i];
+    float x = Lsm6dsoFifo::toG(sample.x);
+    float y = Lsm6dsoFifo::toG(sample.y);
+    float z = Lsm6dsoFifo::toG(sample.z);
+
+    if (ready()) {
+      step(sample.index, x * upX + y * upY + z * upZ - magnitude, events, count);
+    } else if (seen >= MOTION_SAMPLES(MOTION_WARMUP_MS)) {
+      counters.readyIndex = sample.index;
+    }
+
+    // 1/n at first so the estimate starts from the first samples rather than from zero, then the fixed weight
+    seen++;
+    float alpha = max(1.0f / seen, 1.0f / MOTION_GRAVITY_SAMPLES);
+    gravityX += alpha * (x - gravityX);
+    gravityY += alpha * (y - gravityY);
+    gravityZ += alpha * (z - gravityZ);
+  }
+  counters.samples += n;
+
+  // on the ground every footfall so far was a step, during a take off only the ones well before it
+  if (n > 0) {
+    if (current == MOTION_GROUND) {
+      release(samples[n - 1].index + 1, events, count);
+    } else {
+      release(takeoffIndex - min(takeoffIndex, (uint32_t) MOTION_SAMPLES(MOTION_TAKEOFF_LEAD_MS)), events, count);
+    }
+  }
+  return count;
+}
+
+void MotionClassifier::printStats(Print &out) const {
+  out.printf("Motion: %lu steps, %lu jumps, %lu footfalls were jumps, %lu push offs and %lu hops that weren't, "
+             "%lu soft landings, gravity %.3f g, classifying since sample %ld\n",
+             counters.steps, counters.jumps, counters.absorbed, counters.pushes, counters.hops,
+             counters.softLandings, gravity(), counters.readyIndex);
+}
@@ -0,0 +1,127 @@
+// MotionClassifier - tells jumps from steps by what happens along gravity rather than by how hard the landing is.
+// Gravity is a continuous low-pass of the acceleration (over anything longer than a jump the push off, flight and
+// landing average out to 1 g) and a sample's vertical acceleration is its projection on gravity minus gravity,
+// so 0 standing still and -1 g in free fall. A jump is a push off
+// (over MOTION_PUSH_G up), then near free fall (under MOTION_FLIGHT_G down) for at least MOTION_MIN_FLIGHT_MS,
+// then a landing impact (over MOTION_LANDING_G up). Walking never leaves the ground for that long, however hard
+// the heel strikes are
+//
+// Footfalls from the StepDetector go in with the samples they were found in. The ones from a possible take off
+// are held until the state machine knows whether it was a jump (then they were its push off and landing) or not
+// (then they're steps). Steps come out up to MOTION_MAX_TAKEOFF_MS late but none are dropped, and nothing waits
+// in a delay() while samples pile up
+
+#ifndef MOTION_CLASSIFIER_H
+#define MOTION_CLASSIFIER_H
+
+#include <Arduino.h>
+#include <Lsm6dsoFifo.h>
+#include <StepDetector.h>
+
+// how far back the gravity estimate effectively looks, long enough to average out a few strides or jumps
+#define MOTION_GRAVITY_TAU_S 4
+
+// no events until the gravity estimate has this much data behind it
+#define MOTION_WARMUP_MS 500
+
+// vertical acceleration (g, gravity taken off) that starts a take off, counts as flight and as a landing
+#define MOTION_PUSH_G 0.4f
+#define MOTION_FLIGHT_G 0.6f
+#define MOTION_LANDING_G 1.0f
+
+// the push off has to turn into flight within MOTION_MAX_TAKEOFF_MS, the flight has to last longer than a
+// running stride's (~100 ms) and the impact has to come within MOTION_MAX_LANDING_MS of it ending
+#define MOTION_MAX_TAKEOFF_MS 300
+#define MOTION_MIN_FLIGHT_MS 150
+#define MOTION_MAX_FLIGHT_MS 1000
+#define MOTION_MAX_LANDING_MS 200
+
+// footfalls this long before the push off and after the landing impact are part of the jump
+#define MOTION_TAKEOFF_LEAD_MS 100
+#define MOTION_SETTLE_MS 300
+
+// footfalls held during a possible take off
+#define MOTION_MAX_PENDING 8
+
+// what feed() can return at most for one block
+#define MOTION_MAX_EVENTS (LSM6DSO_BURST_WORDS + MOTION_MAX_PENDING)
+
+typedef enum MotionKind {
+  MOTION_STEP,
+  MOTION_JUMP
+} MotionKind;
+
+typedef enum MotionState {
+  MOTION_GROUND,
+  MOTION_TAKEOFF,  // pushing off, waiting to see if the feet leave the ground
+  MOTION_FLIGHT,
+  MOTION_LANDING   // flight ended, waiting for the impact
+} MotionState;
+
+typedef struct MotionEvent {
+  MotionKind kind;
+  uint32_t index;  // sample the footfall started at, or the jump's push off
+  float airtime;   // jumps: seconds in the air
+} MotionEvent;
+
+// counters to check from the serial monitor how the classifier is doing
+typedef struct MotionClassifierStats {
+  unsigned long samples = 0;
+  unsigned long steps = 0;
+  unsigned long jumps = 0;
+  unsigned long pushes = 0;        // take offs that never left the ground
+  unsigned long hops = 0;          // flights too short or too long to be a jump
+  unsigned long softLandings = 0;  // flights with no impact after them
+  unsigned long absorbed = 0;      // footfalls that were a jump's push off or landing
+  long readyIndex = -1;            // sample the classifier started at
+} MotionClassifierStats;
+
+class MotionClassifier {
+public:
+  // runs a block of samples and the footfalls the StepDetector found in it through the classifier, fills events
+  // (MOTION_MAX_EVENTS of them) with the steps and jumps it's sure about, in order, and returns how many
+  size_t feed(const ImuSample *samples, size_t n, const StepEvent *footfalls, size_t found, MotionEvent *events);
+
+  // back to no gravity estimate and nothing held, for when the sample stream restarts
+  void reset();
+
+  bool ready() const { return counters.readyIndex >= 0; }
+  MotionState state() const { return current; }
+
+  // footfalls held back until the state machine knows if they're part of a jump
+  size_t held() const { return pendingCount; }
+
+  // gravity as the low-pass has it, in g
+  float gravity() const { return sqrtf(gravityX * gravityX + gravityY * gravityY + gravityZ * gravityZ); }
+
+  const MotionClassifierStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  void step(uint32_t index, float vertical, MotionEvent *events, size_t &count);
+  void hold(const StepEvent &footfall, MotionEvent *events, size_t &count);
+  void release(uint32_t before, MotionEvent *events, size_t &count);
+  bool inJump(uint32_t index) const;
+
+  float gravityX = 0;
+  float gravityY = 0;
+  float gravityZ = 0;
+  unsigned long seen = 0;
+
+  MotionState current = MOTION_GROUND;
+  uint32_t takeoffIndex = 0;
+  uint32_t flightIndex = 0;
+  uint32_t landingIndex = 0;
+  float airtime = 0;
+
+  // the last jump, from its lead in to the end of settling (empty until there's been one)
+  uint32_t jumpFrom = 0;
+  uint32_t jumpTo = 0;
+
+  StepEvent pending[MOTION_MAX_PENDING];  // oldest first
+  size_t pendingCount = 0;
+
+  MotionClassifierStats counters;
+};
+
+#endif
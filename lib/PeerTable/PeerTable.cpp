@@ -0,0 +1,99 @@
+#include "PeerTable.h"
+
+// FNV-1a over the MAC, the vendor bytes are usually shared so all 6 bytes go in
+static uint32_t macHash(const uint8_t *mac) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < 6; i++) {
+    hash = (hash ^ mac[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void addStats(LinkReceiverStats &sum, const LinkReceiverStats &stats) {
+  sum.received += stats.received;
+  sum.duplicates += stats.duplicates;
+  sum.outOfOrder += stats.outOfOrder;
+  sum.lost += stats.lost;
+  sum.restarts += stats.restarts;
+}
+
+PeerTable::PeerTable() {
+  memset(slots, 0, sizeof(slots));
+}
+
+int PeerTable::stalest(unsigned long now) const {
+  int oldest = -1;
+  for (uint8_t i = 0; i < count; i++) {
+    if (oldest < 0 || now - peers[i].lastSeenMs > now - peers[oldest].lastSeenMs) {
+      oldest = i;
+    }
+  }
+  if (oldest < 0 || now - peers[oldest].lastSeenMs < PEER_TABLE_STALE_MS || peers[oldest].speed.pending()) {
+    return -1;
+  }
+  return oldest;
+}
+
+void PeerTable::evict(uint8_t i) {
+  addStats(evictedLinks, peers[i].link.stats());
+  evictions++;
+
+  count--;
+  if (i != count) {
+    peers[i] = peers[count];
+  }
+  peers[count] = Peer();
+
+  // only happens once a vehicle has been gone for minutes, so rebuilding all slots is cheap enough
+  memset(slots, 0, sizeof(slots));
+  for (uint8_t p = 0; p < count; p++) {
+    uint32_t slot = macHash(peers[p].mac) & (PEER_TABLE_SLOTS - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (PEER_TABLE_SLOTS - 1);
+    }
+    slots[slot] = p + 1;
+  }
+}
+
+Peer *PeerTable::find(const uint8_t *mac, unsigned long now) {
+  // linear probing, there's always an empty slot since the table never gets more than half full
+  uint32_t slot = macHash(mac) & (PEER_TABLE_SLOTS - 1);
+  while (slots[slot] != 0) {
+    Peer &peer = peers[slots[slot] - 1];
+    if (memcmp(peer.mac, mac, 6) == 0) {
+      peer.lastSeenMs = now;
+      return &peer;
+    }
+    slot = (slot + 1) & (PEER_TABLE_SLOTS - 1);
+  }
+
+  if (count == PEER_TABLE_CAPACITY) {
+    int stale = stalest(now);
+    if (stale < 0) {
+      full++;
+      return NULL;
+    }
+    evict(stale);
+
+    // the chain the new MAC goes on may have changed
+    slot = macHash(mac) & (PEER_TABLE_SLOTS - 1);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & (PEER_TABLE_SLOTS - 1);
+    }
+  }
+
+  Peer &peer = peers[count];
+  memcpy(peer.mac, mac, 6);
+  snprintf(peer.id, sizeof(peer.id), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  peer.lastSeenMs = now;
+  slots[slot] = ++count;
+  return &peer;
+}
+
+LinkReceiverStats PeerTable::totals() const {
+  LinkReceiverStats sum = evictedLinks;
+  for (uint8_t i = 0; i < count; i++) {
+    addStats(sum, peers[i].link.stats());
+  }
+  return sum;
+}
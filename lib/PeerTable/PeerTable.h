@@ -0,0 +1,71 @@
+// PeerTable - per-vehicle state on the devkitV1, keyed by the sender MAC that ESP-NOW hands the receive
+// callback. Fixed size and open addressed, so finding a vehicle is a hash and a couple of compares with no
+// heap use no matter how many TTGOs are sending
+
+#ifndef PEER_TABLE_H
+#define PEER_TABLE_H
+
+#include <Arduino.h>
+#include <ReliableLink.h>
+#include <SpeedAggregator.h>
+
+// most vehicles one gateway keeps track of at once. When it's full a new vehicle takes the place of the one
+// heard from longest ago if that's been silent for PEER_TABLE_STALE_MS, otherwise its frames are counted and
+// dropped
+#define PEER_TABLE_CAPACITY 32
+
+// how long a vehicle has to be silent before its entry can go to a new one (a board swapped out or reflashed
+// with another MAC never comes back). Well above the TTGO's heartbeat, so a vehicle that's just parked keeps it
+#define PEER_TABLE_STALE_MS (10UL * 60 * 1000)
+
+// hash slots, twice the capacity keeps probe chains short (has to be a power of 2)
+#define PEER_TABLE_SLOTS 64
+
+static_assert((PEER_TABLE_SLOTS & (PEER_TABLE_SLOTS - 1)) == 0, "PEER_TABLE_SLOTS must be a power of 2");
+static_assert(PEER_TABLE_SLOTS > PEER_TABLE_CAPACITY, "probing needs at least one empty slot");
+static_assert(PEER_TABLE_CAPACITY < 255, "slots store peer index + 1 in a byte");
+
+// everything the gateway remembers about one vehicle
+typedef struct Peer {
+  uint8_t mac[6];
+  char id[13];                 // MAC as 12 hex digits, the vehicle ID sent to the cloud
+  LinkReceiver link;           // sequence number checks/counters for this sender
+  uint8_t lights = 0;          // LIGHT_* bitmask of the last frame used, to spot light changes
+  SpeedAggregator speed;       // rolling speed statistics uploaded instead of every sample
+  unsigned long lastSeenMs = 0; // gateway millis() of its last frame, decides which vehicle gets evicted
+} Peer;
+
+class PeerTable {
+public:
+  PeerTable();
+
+  // the vehicle with this MAC, added if it's new. NULL if the table is full and no vehicle in it is stale (or the
+  // stale one still has a summary to upload). Evicting moves the last peer into the freed index, so at(i) may
+  // point at another vehicle after a find()
+  Peer *find(const uint8_t *mac, unsigned long now);
+
+  uint8_t size() const { return count; }
+  Peer &at(uint8_t i) { return peers[i]; }
+  const Peer &at(uint8_t i) const { return peers[i]; }
+  unsigned long rejected() const { return full; }
+  unsigned long evicted() const { return evictions; }
+
+  // link counters of every vehicle added together, evicted ones included
+  LinkReceiverStats totals() const;
+
+private:
+  // index of the vehicle heard from longest ago if it can make room at now, -1 if none can
+  int stalest(unsigned long now) const;
+
+  // removes peers[i] and rehashes the rest, the probe chains can't just have a hole punched in them
+  void evict(uint8_t i);
+
+  Peer peers[PEER_TABLE_CAPACITY];
+  uint8_t slots[PEER_TABLE_SLOTS];  // index into peers + 1, 0 = empty
+  uint8_t count = 0;
+  unsigned long full = 0;           // frames from vehicles that didn't fit
+  unsigned long evictions = 0;
+  LinkReceiverStats evictedLinks;   // link counters of the evicted vehicles
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "ReliableLink.h"
+#include <esp_now.h>
+
+LinkSender::LinkSender(const uint8_t *peerAddr, uint8_t maxRetries, unsigned long baseBackoffMs,
+                       unsigned long maxBackoffMs)
+  : maxRetries(maxRetries), baseBackoffMs(baseBackoffMs), maxBackoffMs(maxBackoffMs) {
+  memcpy(peer, peerAddr, sizeof(peer));
+}
+
+bool LinkSender::send(const uint8_t *data, size_t len) {
+  if (len > sizeof(frame)) {
+    return false;
+  }
+
+  // newer state replaces whatever hasn't made it through yet
+  if (state != LINK_IDLE) {
+    counters.dropped++;
+  }
+
+  memcpy(frame, data, len);
+  frameLen = len;
+  attempt = 0;
+  counters.sent++;
+  return transmit();
+}
+
+void LinkSender::onSendStatus(bool success) {
+  sendResult = success ? 1 : 0;
+}
+
+void LinkSender::update() {
+  int result = sendResult.exchange(-1);
+
+  if (state == LINK_IN_FLIGHT && result == 1) {
+    counters.acked++;
+    state = LINK_IDLE;
+  }
+  else if (state == LINK_IN_FLIGHT && result == 0) {
+    if (attempt >= maxRetries) {
+      counters.dropped++;
+      state = LINK_IDLE;
+    } else {
+      // wait base, 2x base, 4x base... (capped) before trying again so we don't hammer a busy channel
+      unsigned long backoff = min(baseBackoffMs << attempt, maxBackoffMs);
+      retryAt = millis() + backoff;
+      state = LINK_BACKOFF;
+    }
+  }
+  else if (state == LINK_BACKOFF && (long) (millis() - retryAt) >= 0) {
+    attempt++;
+    counters.retried++;
+    transmit();
+  }
+}
+
+bool LinkSender::transmit() {
+  // set before sending since the callback can fire before esp_now_send returns
+  sendResult = -1;
+  state = LINK_IN_FLIGHT;
+  if (esp_now_send(peer, frame, frameLen) != ESP_OK) {
+    // counts as a failed delivery so it goes through the same retry path
+    sendResult = 0;
+    return false;
+  }
+  return true;
+}
+
+void LinkSender::printStats(Print &out) const {
+  out.printf("Link: %lu sent, %lu acked, %lu retried, %lu dropped\n",
+             counters.sent, counters.acked, counters.retried, counters.dropped);
+}
+
+LinkResult LinkReceiver::accept(uint16_t sequence, uint32_t senderMs) {
+  // signed differences handle the 16 bit sequence and 32 bit millis() wraparounds
+  int16_t diff = (int16_t) (sequence - highest);
+  int32_t behindMs = (int32_t) (highestMs - senderMs);
+
+  // the sender seals frames in sequence order and a retransmission keeps its frame's time stamp, so a newer frame
+  // is never from earlier, the same one is never from another time and an older one never from later or from
+  // long before. Any of those means its counts started over, wherever the sequence lands
+  bool restarted;
+  if (diff > 0) {
+    restarted = behindMs > 0;
+  } else if (diff == 0) {
+    restarted = behindMs != 0;
+  } else {
+    restarted = diff <= -32 || behindMs < 0 || behindMs > LINK_MAX_LATE_MS;
+  }
+
+  if (!started || restarted) {
+    if (started) {
+      counters.restarts++;
+    }
+    started = true;
+    highest = sequence;
+    highestMs = senderMs;
+    seen = 1;
+    counters.received++;
+    return LINK_NEW;
+  }
+
+  if (diff > 0) {
+    // anything skipped over is lost (for now, it could still show up late)
+    counters.lost += diff - 1;
+    seen = diff < 32 ? (seen << diff) | 1 : 1;
+    highest = sequence;
+    highestMs = senderMs;
+    counters.received++;
+    return LINK_NEW;
+  }
+
+  uint32_t bit = (uint32_t) 1 << -diff;
+  if (seen & bit) {
+    counters.duplicates++;
+    return LINK_DUPLICATE;
+  }
+  // a frame we counted as lost did make it after all, but a newer one was already used
+  // (nothing was counted for it if it's from before the first frame we saw)
+  seen |= bit;
+  if (counters.lost > 0) {
+    counters.lost--;
+  }
+  counters.outOfOrder++;
+  return LINK_OUT_OF_ORDER;
+}
+
+void LinkReceiver::printStats(Print &out) const {
+  out.printf("Link: %lu received, %lu duplicates, %lu out of order, %lu lost, %lu sender restarts\n",
+             counters.received, counters.duplicates, counters.outOfOrder, counters.lost, counters.restarts);
+}
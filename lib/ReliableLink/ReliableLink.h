@@ -0,0 +1,104 @@
+// ReliableLink - retransmission for ESP-NOW frames on the sender and sequence number checks on the receiver,
+// plus counters on both sides so we can tell how good the link is
+
+#ifndef RELIABLE_LINK_H
+#define RELIABLE_LINK_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// biggest frame the sender keeps a copy of for retransmitting
+#define LINK_MAX_FRAME_LEN 32
+
+typedef struct LinkSenderStats {
+  unsigned long sent = 0;     // new frames handed to send()
+  unsigned long acked = 0;    // frames the receiver confirmed (on any attempt)
+  unsigned long retried = 0;  // extra transmissions after a failed delivery
+  unsigned long dropped = 0;  // frames given up on (out of retries or replaced by a newer frame)
+} LinkSenderStats;
+
+// sender side: resends the current frame with exponential backoff whenever the radio reports a failed delivery
+class LinkSender {
+public:
+  // backoff goes baseBackoffMs, 2x, 4x, ... up to maxBackoffMs, and the frame is dropped after maxRetries
+  LinkSender(const uint8_t *peerAddr, uint8_t maxRetries = 5, unsigned long baseBackoffMs = 10,
+             unsigned long maxBackoffMs = 200);
+
+  // starts sending a new frame, a frame that's still being retried is dropped since this one is newer
+  bool send(const uint8_t *data, size_t len);
+
+  // call from the ESP-NOW send callback (WiFi task), only records the result for update()
+  void onSendStatus(bool success);
+
+  // call every loop(): handles the last delivery result and retransmits once the backoff is over
+  void update();
+
+  bool busy() const { return state != LINK_IDLE; }
+  const LinkSenderStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  enum LinkState {
+    LINK_IDLE,        // nothing to send
+    LINK_IN_FLIGHT,   // waiting for the send callback
+    LINK_BACKOFF      // last attempt failed, waiting to retry
+  };
+
+  bool transmit();
+
+  uint8_t peer[6];
+  uint8_t maxRetries;
+  unsigned long baseBackoffMs;
+  unsigned long maxBackoffMs;
+
+  uint8_t frame[LINK_MAX_FRAME_LEN];
+  size_t frameLen = 0;
+  LinkState state = LINK_IDLE;
+  uint8_t attempt = 0;
+  unsigned long retryAt = 0;
+
+  // written by the WiFi task, read by loop(): -1 = no result yet, 0 = failed, 1 = delivered
+  std::atomic<int> sendResult{-1};
+
+  LinkSenderStats counters;
+};
+
+// what the receiver should do with a frame
+enum LinkResult {
+  LINK_NEW,           // newest frame so far, use it
+  LINK_DUPLICATE,     // already seen (a retransmission whose ack got lost)
+  LINK_OUT_OF_ORDER   // older than one we already used, ignore it
+};
+
+// a retransmitted frame can turn up after a newer one, but never further behind it (by the sender's clock) than
+// this. Well over the sender's whole retry schedule (10-160 ms backoffs, ~310 ms for 5 retries)
+#define LINK_MAX_LATE_MS 1000
+
+typedef struct LinkReceiverStats {
+  unsigned long received = 0;    // frames accepted as new
+  unsigned long duplicates = 0;
+  unsigned long outOfOrder = 0;
+  unsigned long lost = 0;        // gaps in the sequence numbers
+  unsigned long restarts = 0;    // sender's sequence or clock jumped back (it rebooted)
+} LinkReceiverStats;
+
+// receiver side: checks 16 bit sequence numbers (with wraparound) against the last 32 seen. The sender's
+// millis() when it sealed the frame tells a reboot (both counted again from 0) from a late retransmission, even
+// when the sequence starts over below where it was
+class LinkReceiver {
+public:
+  LinkResult accept(uint16_t sequence, uint32_t senderMs);
+
+  const LinkReceiverStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  bool started = false;
+  uint16_t highest = 0;   // newest sequence number accepted
+  uint32_t highestMs = 0; // and the sender's clock when it sent it
+  uint32_t seen = 0;      // bit i set = highest - i has been received
+
+  LinkReceiverStats counters;
+};
+
+#endif
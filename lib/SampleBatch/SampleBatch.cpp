@@ -0,0 +1,78 @@
+#include "SampleBatch.h"
+
+SampleBatch::SampleBatch(const FlushPolicy &policy) : policy(policy) {}
+
+void SampleBatch::push(const Sample &sample, bool urgent) {
+  if (urgent) {
+    lastChange = pushed + 1;
+  }
+
+  if (count == SAMPLE_BATCH_CAPACITY) {
+    // full (cloud probably unreachable), keep the newest data
+    head = (head + 1) % SAMPLE_BATCH_CAPACITY;
+    count--;
+    dropped++;
+  }
+
+  samples[(head + count) % SAMPLE_BATCH_CAPACITY] = sample;
+  count++;
+  pushed++;
+}
+
+bool SampleBatch::shouldFlush(unsigned long now) const {
+  if (count == 0) {
+    return false;
+  }
+  if (count >= policy.maxSamples) {
+    return true;
+  }
+  // the urgent sample is still in the buffer if it's one of the last count pushed
+  if (policy.flushOnLightChange && lastChange != 0 && pushed - lastChange < count) {
+    return true;
+  }
+  return now - samples[head].receivedMs >= policy.maxAgeMs;
+}
+
+uint8_t SampleBatch::peek(Sample *out, uint8_t max) const {
+  uint8_t n = min(max, count);
+  for (uint8_t i = 0; i < n; i++) {
+    out[i] = samples[(head + i) % SAMPLE_BATCH_CAPACITY];
+  }
+  return n;
+}
+
+void SampleBatch::consume(unsigned long from, uint8_t n) {
+  // samples only ever leave from the oldest end, so the ones sent that are still here are the oldest ones
+  // up to from + n
+  unsigned long end = from + n;
+  unsigned long oldest = position();
+  if ((long) (end - oldest) <= 0) {
+    return;
+  }
+  uint8_t sent = min(end - oldest, (unsigned long) count);
+  head = (head + sent) % SAMPLE_BATCH_CAPACITY;
+  count -= sent;
+}
+
+size_t formatBatch(const Sample *samples, uint8_t count, unsigned long now, char *out, size_t outSize) {
+  size_t len = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    const Sample &s = samples[i];
+
+    // events get marked with an "E," in front and the event bits at the end
+    char events[6] = "";
+    if (s.events != 0) {
+      snprintf(events, sizeof(events), ",%u", s.events);
+    }
+
+    int n = snprintf(out + len, outSize - len, "%s%02x%02x%02x%02x%02x%02x,%lu,%lu,%u,%u%s\n",
+                     s.events != 0 ? "E," : "",
+                     s.vehicle[0], s.vehicle[1], s.vehicle[2], s.vehicle[3], s.vehicle[4], s.vehicle[5],
+                     (unsigned long) s.senderMs, (unsigned long) (now - s.receivedMs), s.lights, s.speed, events);
+    if (n < 0 || (size_t) n >= outSize - len) {
+      return 0;
+    }
+    len += n;
+  }
+  return len;
+}
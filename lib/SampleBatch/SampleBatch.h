@@ -0,0 +1,81 @@
+// SampleBatch - fixed size ring buffer of vehicle samples on the devkitV1, so they can be sent to the
+// cloud as one batch POST instead of one HTTP round trip per sample
+
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include <Arduino.h>
+
+// how many samples the gateway can hold before the oldest ones get overwritten
+#define SAMPLE_BATCH_CAPACITY 64
+
+// longest line formatBatch writes per sample (event flag, vehicle, two 10 digit times, lights, speed, separators)
+#define SAMPLE_LINE_MAX 56
+
+// why the gateway kept a sample when it's aggregating instead of forwarding everything (bits of Sample.events)
+#define SAMPLE_EVENT_LIGHTS    (1 << 0)  // a dash light turned on/off
+#define SAMPLE_EVENT_SPEEDING  (1 << 1)  // speed went over the limit
+#define SAMPLE_EVENT_SPEED_OK  (1 << 2)  // speed dropped back under it
+
+// one reading from a TTGO plus when it was taken/received
+typedef struct Sample {
+  uint8_t vehicle[6] = {0}; // sender MAC, goes to the cloud as the vehicle ID
+  uint32_t senderMs = 0;    // millis() on the TTGO when the frame was sent
+  uint32_t receivedMs = 0;  // millis() on the devkitV1 when the frame arrived
+  uint8_t lights = 0;       // LIGHT_* bitmask straight from the frame
+  uint8_t speed = 0;
+  uint8_t events = 0;       // SAMPLE_EVENT_* bits, 0 = a raw sample forwarded as is
+} Sample;
+
+// decides when the buffered samples are sent, fewer flushes = fewer radio wake-ups but older data on the dashboard
+typedef struct FlushPolicy {
+  uint8_t maxSamples;       // flush once this many samples are buffered
+  unsigned long maxAgeMs;   // or once the oldest buffered sample is this old
+  bool flushOnLightChange;  // or right away when a dash light turns on/off or another event comes in (those matter
+                            // more than speed)
+} FlushPolicy;
+
+class SampleBatch {
+public:
+  SampleBatch(const FlushPolicy &policy);
+
+  // adds a sample, overwriting the oldest one if the buffer is full. urgent says whether a dash light of that
+  // vehicle changed with it or it's an event (the caller keeps track per vehicle)
+  void push(const Sample &sample, bool urgent);
+
+  // true once the flush policy says the buffered samples should be sent
+  bool shouldFlush(unsigned long now) const;
+
+  // copies up to max of the oldest samples into out without removing them (returns how many were copied)
+  uint8_t peek(Sample *out, uint8_t max) const;
+
+  // where the oldest buffered sample is, counting every sample ever pushed. Taken together with peek() it
+  // tells consume() which samples went out, even if push() has overwritten some of them since
+  unsigned long position() const { return pushed - count; }
+
+  // removes the count samples peeked at position once the server has them. Those push() already overwrote are
+  // gone anyway (and counted in overwritten()), samples pushed after the peek are never removed
+  void consume(unsigned long from, uint8_t count);
+
+  uint8_t size() const { return count; }
+  unsigned long overwritten() const { return dropped; }
+
+private:
+  FlushPolicy policy;
+  Sample samples[SAMPLE_BATCH_CAPACITY];
+  uint8_t head = 0;   // oldest sample
+  uint8_t count = 0;
+  unsigned long pushed = 0;       // samples pushed so far, used to tell if the light change is still buffered
+  unsigned long lastChange = 0;   // value of pushed when the last urgent sample came in (0 = never)
+  unsigned long dropped = 0;
+};
+
+// writes samples as the compact batch body the cloud server expects, one line per sample:
+// "<vehicle>,<sender ms>,<age ms>,<lights>,<speed>\n" for raw samples and
+// "E,<vehicle>,<sender ms>,<age ms>,<lights>,<speed>,<events>\n" for events,
+// where vehicle is the sender MAC as 12 hex digits, age is how long ago (at now) the gateway got it and lights
+// is the LIGHT_* bitmask as a decimal number
+// returns the body length, or 0 if it didn't fit into out
+size_t formatBatch(const Sample *samples, uint8_t count, unsigned long now, char *out, size_t outSize);
+
+#endif
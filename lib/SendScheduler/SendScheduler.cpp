@@ -0,0 +1,49 @@
+#include "SendScheduler.h"
+
+SendScheduler::SendScheduler(const SendPolicy &policy) : policy(policy) {}
+
+SendReason SendScheduler::check(uint8_t lights, uint8_t speed, unsigned long now) {
+  if (!started) {
+    return SEND_LIGHT_CHANGE;
+  }
+
+  SendReason reason = SEND_NONE;
+  if (lights != sentLights) {
+    reason = SEND_LIGHT_CHANGE;
+  } else if (abs((int) speed - (int) sentSpeed) > policy.speedDeadband) {
+    reason = SEND_SPEED_CHANGE;
+  } else if (now - lastSent >= policy.heartbeatMs) {
+    return SEND_HEARTBEAT;
+  }
+
+  if (reason != SEND_NONE && now - lastSent < policy.minIntervalMs) {
+    // the change still goes out (with whatever the state is by then) once the interval is over
+    if (!held) {
+      counters.rateLimited++;
+      held = true;
+    }
+    return SEND_NONE;
+  }
+  return reason;
+}
+
+void SendScheduler::sent(SendReason reason, uint8_t lights, uint8_t speed, unsigned long now) {
+  started = true;
+  held = false;
+  sentLights = lights;
+  sentSpeed = speed;
+  lastSent = now;
+
+  if (reason == SEND_LIGHT_CHANGE) {
+    counters.lightChanges++;
+  } else if (reason == SEND_SPEED_CHANGE) {
+    counters.speedChanges++;
+  } else if (reason == SEND_HEARTBEAT) {
+    counters.heartbeats++;
+  }
+}
+
+void SendScheduler::printStats(Print &out) const {
+  out.printf("Sends: %lu light changes, %lu speed changes, %lu heartbeats, %lu rate limited\n",
+             counters.lightChanges, counters.speedChanges, counters.heartbeats, counters.rateLimited);
+}
@@ -0,0 +1,54 @@
+// SendScheduler - decides when the TTGO sends a frame: right away when a dash light changes or the speed moves
+// by more than a deadband, otherwise only a slow heartbeat so the devkitV1 knows we're still here
+
+#ifndef SEND_SCHEDULER_H
+#define SEND_SCHEDULER_H
+
+#include <Arduino.h>
+
+// why a frame should go out now
+enum SendReason {
+  SEND_NONE = 0,
+  SEND_LIGHT_CHANGE,  // a dash light turned on/off
+  SEND_SPEED_CHANGE,  // speed moved past the deadband
+  SEND_HEARTBEAT      // nothing changed for heartbeatMs
+};
+
+typedef struct SendPolicy {
+  unsigned long heartbeatMs;    // resend the unchanged state this often
+  unsigned long minIntervalMs;  // never send more often than this (a chattering potentiometer gets held back)
+  uint8_t speedDeadband;        // speed changes of this many mph or less don't count as a change
+} SendPolicy;
+
+typedef struct SendStats {
+  unsigned long lightChanges = 0;  // frames sent because of a light change
+  unsigned long speedChanges = 0;  // frames sent because of a speed change
+  unsigned long heartbeats = 0;
+  unsigned long rateLimited = 0;   // changes that had to wait for minIntervalMs
+} SendStats;
+
+class SendScheduler {
+public:
+  SendScheduler(const SendPolicy &policy);
+
+  // call every loop() with the current state, returns why it should be sent now (SEND_NONE = not yet)
+  SendReason check(uint8_t lights, uint8_t speed, unsigned long now);
+
+  // call after the frame went out so later changes are compared against what the receiver has
+  void sent(SendReason reason, uint8_t lights, uint8_t speed, unsigned long now);
+
+  const SendStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  SendPolicy policy;
+  bool started = false;       // nothing sent yet, the first check always sends
+  uint8_t sentLights = 0;     // state in the last frame sent
+  uint8_t sentSpeed = 0;
+  unsigned long lastSent = 0;
+  bool held = false;          // a change is currently waiting on the rate cap (so it's only counted once)
+
+  SendStats counters;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#include "SpeedAggregator.h"
+
+SpeedEvent SpeedAggregator::add(uint8_t speed, uint32_t now, uint8_t limit) {
+  // the speed is assumed to stay where it was until the next reading, so the time since the last one counts
+  // as over the limit if that one was
+  if (started && over) {
+    current.overLimitMs += now - lastMs;
+  }
+
+  if (current.samples == 0) {
+    current.startMs = now;
+  }
+  current.endMs = now;
+  current.samples++;
+  current.minSpeed = min(current.minSpeed, speed);
+  current.maxSpeed = max(current.maxSpeed, speed);
+  current.speedSum += speed;
+
+  bool nowOver = speed >= limit;
+  SpeedEvent event = SPEED_EVENT_NONE;
+  if (nowOver && !over) {
+    event = SPEED_EVENT_OVER;
+  } else if (!nowOver && over) {
+    event = SPEED_EVENT_UNDER;
+  }
+
+  started = true;
+  over = nowOver;
+  lastMs = now;
+  return event;
+}
+
+void SpeedAggregator::close() {
+  if (current.samples == 0) {
+    return;
+  }
+
+  if (!closedPending) {
+    closedWindow = current;
+  } else {
+    closedWindow.endMs = current.endMs;
+    closedWindow.samples += current.samples;
+    closedWindow.minSpeed = min(closedWindow.minSpeed, current.minSpeed);
+    closedWindow.maxSpeed = max(closedWindow.maxSpeed, current.maxSpeed);
+    closedWindow.speedSum += current.speedSum;
+    closedWindow.overLimitMs += current.overLimitMs;
+  }
+  closedPending = true;
+  current = SpeedWindow();
+}
+
+size_t formatSummary(const char *vehicle, const SpeedWindow &window, unsigned long now, char *out, size_t outSize) {
+  if (window.samples == 0) {
+    return 0;
+  }
+  int n = snprintf(out, outSize, "S,%s,%lu,%lu,%u,%u,%u,%u,%lu\n", vehicle,
+                   (unsigned long) (now - window.startMs), (unsigned long) (now - window.endMs), window.samples,
+                   window.minSpeed, window.maxSpeed, (unsigned) ((window.speedSum + window.samples / 2) / window.samples),
+                   (unsigned long) window.overLimitMs);
+  return n < 0 || (size_t) n >= outSize ? 0 : n;
+}
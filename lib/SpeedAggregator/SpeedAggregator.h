@@ -0,0 +1,60 @@
+// SpeedAggregator - rolling speed statistics of one vehicle, kept on the devkitV1 so only a summary per window
+// (plus the moments the speed limit is crossed) has to go to the cloud instead of every sample
+
+#ifndef SPEED_AGGREGATOR_H
+#define SPEED_AGGREGATOR_H
+
+#include <Arduino.h>
+
+// longest line formatSummary writes
+#define SUMMARY_LINE_MAX 72
+
+// what add() noticed about a reading
+enum SpeedEvent {
+  SPEED_EVENT_NONE = 0,
+  SPEED_EVENT_OVER,   // went from under the limit to at/over it
+  SPEED_EVENT_UNDER   // dropped back under the limit
+};
+
+// statistics of the readings between two close() calls
+typedef struct SpeedWindow {
+  uint32_t startMs = 0;      // gateway millis() of the first reading
+  uint32_t endMs = 0;        // and of the last one
+  uint16_t samples = 0;
+  uint8_t minSpeed = 255;
+  uint8_t maxSpeed = 0;
+  uint32_t speedSum = 0;     // mean is speedSum / samples
+  uint32_t overLimitMs = 0;  // how long the speed was at/over the limit
+} SpeedWindow;
+
+class SpeedAggregator {
+public:
+  // adds a reading received at now (ms), returns whether it crossed the limit
+  SpeedEvent add(uint8_t speed, uint32_t now, uint8_t limit);
+
+  // ends the current window. If the last closed window hasn't been uploaded yet the two are merged,
+  // so a failed upload only delays the numbers instead of losing them
+  void close();
+
+  // a closed window is waiting to be uploaded
+  bool pending() const { return closedPending; }
+  const SpeedWindow &closed() const { return closedWindow; }
+  void uploaded() { closedPending = false; }
+
+  bool overLimit() const { return over; }
+
+private:
+  SpeedWindow current;
+  SpeedWindow closedWindow;
+  bool closedPending = false;
+
+  bool started = false;
+  bool over = false;        // last reading was at/over the limit
+  uint32_t lastMs = 0;      // when the last reading came in, time over the limit is counted from it
+};
+
+// writes one window as "S,<vehicle>,<start age ms>,<end age ms>,<samples>,<min>,<max>,<mean>,<ms over limit>\n"
+// where the ages are how long before now the first/last reading came in. Returns the length, 0 if it didn't fit
+size_t formatSummary(const char *vehicle, const SpeedWindow &window, unsigned long now, char *out, size_t outSize);
+
+#endif
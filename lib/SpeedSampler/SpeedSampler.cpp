@@ -0,0 +1,69 @@
+#include "SpeedSampler.h"
+#include <driver/i2s.h>
+#include <freertos/task.h>
+
+void SpeedFilter::feed(const uint16_t *samples, size_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  uint32_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += samples[i] & 0x0FFF;
+  }
+  // average scaled to 16 bits: sum * 16 / count, the 4 extra bits are real once count is 256
+  uint32_t average = (sum << 4) / count;
+
+  if (!started) {
+    filtered = average << SPEED_FILTER_SHIFT;
+    started = true;
+  } else {
+    // filtered += (average - filtered / 2^shift), i.e. an exponential moving average
+    filtered = filtered - (filtered >> SPEED_FILTER_SHIFT) + average;
+  }
+}
+
+bool SpeedSampler::begin(adc1_channel_t channel) {
+  i2s_config_t config = {};
+  config.mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN;
+  config.sample_rate = SPEED_SAMPLE_RATE;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_STAND_I2S;
+  config.intr_alloc_flags = 0;
+  config.dma_buf_count = 4;
+  config.dma_buf_len = SPEED_BLOCK_LEN;
+  config.use_apll = false;
+
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  adc1_config_channel_atten(channel, ADC_ATTEN_DB_11); // full 0-3.3V swing of the potentiometer
+
+  if (i2s_driver_install(I2S_NUM_0, &config, 0, NULL) != ESP_OK ||
+      i2s_set_adc_mode(ADC_UNIT_1, channel) != ESP_OK ||
+      i2s_adc_enable(I2S_NUM_0) != ESP_OK) {
+    return false;
+  }
+
+  return xTaskCreatePinnedToCore(samplingTask, "speed", 4096, this, 1, NULL, 0) == pdPASS;
+}
+
+void SpeedSampler::samplingTask(void *arg) {
+  SpeedSampler *sampler = (SpeedSampler *) arg;
+  uint16_t block[SPEED_BLOCK_LEN];
+
+  while (true) {
+    // sleeps until the DMA has filled a block, the CPU isn't involved in the conversions themselves
+    size_t bytesRead = 0;
+    if (i2s_read(I2S_NUM_0, block, sizeof(block), &bytesRead, portMAX_DELAY) != ESP_OK) {
+      continue;
+    }
+
+    sampler->filter.feed(block, bytesRead / sizeof(uint16_t));
+    uint16_t value = sampler->filter.value();
+
+    // 0-65520 to 0-100 mph, rounded
+    sampler->latestRaw.store(value, std::memory_order_relaxed);
+    sampler->latestSpeed.store((uint8_t) (((uint32_t) value * 100 + 32760) / 65520), std::memory_order_relaxed);
+    sampler->blockCount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,56 @@
+// SpeedSampler - reads the speed potentiometer continuously with the ADC streaming into memory over DMA
+// (I2S built-in ADC mode) instead of a blocking analogRead() on every loop(). A background task averages
+// each DMA block and low-pass filters the averages in integer math; loop() just loads the newest result
+
+#ifndef SPEED_SAMPLER_H
+#define SPEED_SAMPLER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <driver/adc.h>
+
+// 256 samples per DMA block at 20 kHz = a new filtered value roughly every 13 ms
+#define SPEED_SAMPLE_RATE 20000
+#define SPEED_BLOCK_LEN   256
+
+// weight of each new block in the low-pass filter is 1/2^SPEED_FILTER_SHIFT
+#define SPEED_FILTER_SHIFT 3
+
+// oversampling + low-pass in integer math, kept separate from the DMA side so it can be fed any samples
+class SpeedFilter {
+public:
+  // averages one block of raw 12 bit ADC samples (channel bits in the top nibble are masked off)
+  // and folds the average into the filter
+  void feed(const uint16_t *samples, size_t count);
+
+  // filtered reading scaled up to 16 bits (0-65520), the extra bits come from averaging the block
+  uint16_t value() const { return (uint16_t) (filtered >> SPEED_FILTER_SHIFT); }
+
+  bool primed() const { return started; }
+
+private:
+  bool started = false;
+  uint32_t filtered = 0;  // value() << SPEED_FILTER_SHIFT so the filter doesn't lose the low bits
+};
+
+class SpeedSampler {
+public:
+  // starts the DMA and the sampling task for an ADC1 channel (GPIO 36 is ADC1_CHANNEL_0)
+  bool begin(adc1_channel_t channel);
+
+  // newest filtered speed, 0-100 mph (lock-free, fine to call every loop())
+  uint8_t speed() const { return latestSpeed.load(std::memory_order_relaxed); }
+  uint16_t raw() const { return latestRaw.load(std::memory_order_relaxed); }
+
+  unsigned long blocks() const { return blockCount.load(std::memory_order_relaxed); }
+
+private:
+  static void samplingTask(void *arg);
+
+  SpeedFilter filter;  // only touched by the sampling task
+  std::atomic<uint16_t> latestRaw{0};
+  std::atomic<uint8_t> latestSpeed{0};
+  std::atomic<unsigned long> blockCount{0};
+};
+
+#endif
@@ -0,0 +1,57 @@
+// SpscQueue - bounded lock-free queue for one producer (e.g. the ESP-NOW receive callback in the WiFi task)
+// and one consumer (loop()). push/pop never block or allocate, so they're safe to call from a callback
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+// N has to be a power of 2 so the free running indexes can be wrapped with a mask
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of 2");
+
+public:
+  // producer side only, returns false (and counts a drop) if the consumer has fallen N items behind
+  bool push(const T &item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == N) {
+      drops.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    items[t & (N - 1)] = item;
+    // release so the consumer sees the item before it sees the new tail
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side only, returns false if there's nothing queued
+  bool pop(T &item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    item = items[h & (N - 1)];
+    // release so the producer only reuses the slot after we've copied it out
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return N; }
+  unsigned long dropped() const { return drops.load(std::memory_order_relaxed); }
+
+private:
+  T items[N];
+  std::atomic<size_t> head{0};  // next item to pop, only written by the consumer
+  std::atomic<size_t> tail{0};  // next slot to push into, only written by the producer
+  std::atomic<unsigned long> drops{0};
+};
+
+#endif
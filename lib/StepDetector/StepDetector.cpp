@@ -0,0 +1,111 @@
+#include "StepDetector.h"
+
+#define STEP_STATS_SAMPLES (1 << STEP_STATS_SHIFT)
+#define STEP_WARMUP_SAMPLES (STEP_WARMUP_MS * LSM6DSO_ODR_HZ / 1000)
+#define STEP_REFRACTORY_SAMPLES (STEP_REFRACTORY_MS * LSM6DSO_ODR_HZ / 1000)
+#define STEP_REFRACTORY_MAX_SAMPLES (STEP_REFRACTORY_MAX_MS * LSM6DSO_ODR_HZ / 1000)
+#define STEP_MAX_GAP_SAMPLES (STEP_MAX_GAP_MS * LSM6DSO_ODR_HZ / 1000)
+
+void StepDetector::reset() {
+  average = 0;
+  variance = 0;
+  seen = 0;
+  rising = false;
+  stepped = false;
+  stepGap = 0;
+  counters = StepDetectorStats();
+}
+
+void StepDetector::update(uint32_t squared) {
+  // 1/n to begin with (the plain average of everything so far), so the first samples aren't weighed against
+  // a mean of zero, then the fixed weight once that's smaller
+  seen++;
+  int64_t diff = (int64_t) (squared >> STEP_SQUARED_SHIFT) - average;
+  if (seen < STEP_STATS_SAMPLES) {
+    average += diff / (int64_t) seen;
+    int64_t spread = variance + diff * diff / (int64_t) seen;
+    variance = spread - spread / (int64_t) seen;
+  } else {
+    average += diff >> STEP_STATS_SHIFT;
+    int64_t spread = variance + ((diff * diff) >> STEP_STATS_SHIFT);
+    variance = spread - (spread >> STEP_STATS_SHIFT);
+  }
+}
+
+// the magnitude's sd from the squares' (it moves half as much, relative to itself, as its square does), given
+// the root mean square
+static float magnitudeSd(int64_t variance, float rms) {
+  if (rms <= 0) {
+    return 0;
+  }
+  return sqrtf((float) variance) * (1 << STEP_SQUARED_SHIFT) * LSM6DSO_G_PER_LSB * LSM6DSO_G_PER_LSB / (2 * rms);
+}
+
+float StepDetector::mean() const {
+  // the mean square is the squared mean plus the variance
+  float rms = accelMagnitude((uint32_t) (average << STEP_SQUARED_SHIFT));
+  float sd = magnitudeSd(variance, rms);
+  return sqrtf(max(rms * rms - sd * sd, 0.0f));
+}
+
+float StepDetector::sd() const {
+  return magnitudeSd(variance, accelMagnitude((uint32_t) (average << STEP_SQUARED_SHIFT)));
+}
+
+size_t StepDetector::feed(const ImuSample *samples, const uint32_t *squared, size_t n, StepEvent *events) {
+  // the thresholds move slowly enough to stay put for a block (18 samples, ~170 ms)
+  float magnitude = mean();
+  float rise = max(STEP_RISE_SD * sd(), STEP_MIN_RISE_G);
+  uint32_t above = accelAboveMask(squared, n, accelThresholdSquared(magnitude + rise));
+  uint32_t stillAbove = accelAboveMask(squared, n, accelThresholdSquared(magnitude + STEP_FALL_FRACTION * rise));
+
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    const ImuSample &sample = samples[i];
+
+    if (!ready() && seen >= STEP_WARMUP_SAMPLES) {
+      counters.readyIndex = sample.index;
+    }
+
+    if (!rising) {
+      if (ready() && ((above >> i) & 1)) {
+        rising = true;
+        riseIndex = sample.index;
+        peakSquared = squared[i];
+        uint32_t gap = sample.index - lastStepIndex;
+        float refractory = min(max((float) STEP_REFRACTORY_SAMPLES, STEP_REFRACTORY_FRACTION * stepGap),
+                               (float) STEP_REFRACTORY_MAX_SAMPLES);
+        counted = !stepped || gap >= refractory;
+        if (counted) {
+          if (stepped && gap < STEP_MAX_GAP_SAMPLES) {
+            stepGap = stepGap == 0 ? gap : stepGap + 0.25f * (gap - stepGap);
+          }
+          stepped = true;
+          lastStepIndex = sample.index;
+        } else {
+          counters.refractory++;
+        }
+      }
+    } else {
+      peakSquared = max(peakSquared, squared[i]);
+      if (!((stillAbove >> i) & 1)) {
+        rising = false;
+        if (counted) {
+          events[count].index = riseIndex;
+          events[count].peak = accelMagnitude(peakSquared);
+          count++;
+          counters.steps++;
+        }
+      }
+    }
+
+    update(squared[i]);
+  }
+  counters.samples += n;
+  return count;
+}
+
+void StepDetector::printStats(Print &out) const {
+  out.printf("Steps: %lu steps, %lu rises ignored as too close, mean %.3f g, sd %.3f g, counting since sample %ld\n",
+             counters.steps, counters.refractory, mean(), sd(), counters.readyIndex);
+}
@@ -0,0 +1,96 @@
+// StepDetector - finds steps in the accelerometer magnitude as the samples stream in, with no calibration phase.
+// It keeps an exponentially weighted mean and variance of the magnitude, and a step is a rise above
+// mean + STEP_RISE_SD standard deviations (never less than STEP_MIN_RISE_G, so standing still doesn't count
+// sensor noise) that ends once the magnitude is back under mean + STEP_FALL_FRACTION of that rise. The gap
+// between the two is the hysteresis the "stepped" flag used to give. A rise too soon after the last step (the
+// refractory window, STEP_REFRACTORY_FRACTION of the usual time between steps and at least STEP_REFRACTORY_MS)
+// is the push off or the same footfall ringing on rather than a new step
+//
+// The statistics start as a plain running average and switch to the slower weighting once there's enough of
+// them, so steps count from STEP_WARMUP_MS after boot instead of after 10-15 s of standing still and walking
+// on command. They're kept in integer squared counts, straight from accelSquaredMagnitudes(), so a sample costs
+// no float math at all. Once per FIFO block they're turned into the magnitude's mean and sd in g (the sd of the
+// square over twice the magnitude, the mean from mean square = mean^2 + sd^2) for thresholds tested with the
+// AccelKernel masks, and a step's peak once per step
+
+#ifndef STEP_DETECTOR_H
+#define STEP_DETECTOR_H
+
+#include <Arduino.h>
+#include <AccelKernel.h>
+
+// weight of a new sample in the mean and variance once warmed up, 1 / 2^STEP_STATS_SHIFT (2.5 s at 104 Hz), long
+// enough to span several strides
+#define STEP_STATS_SHIFT 8
+
+// squared magnitudes lose this many bits going into the statistics, so a difference squared fits int64
+#define STEP_SQUARED_SHIFT 4
+
+// no steps until the statistics have this much data behind them
+#define STEP_WARMUP_MS 500
+
+#define STEP_RISE_SD 1.3f
+#define STEP_MIN_RISE_G 0.15f
+#define STEP_FALL_FRACTION 0.4f
+
+// the push off comes ~40% of the way to the next heel strike, and even running is under 4 steps/s. The window
+// never goes past STEP_REFRACTORY_MAX_MS (a brisk walk is ~2 steps/s): missing every other step would double
+// the measured gap, which would keep the window wide enough to go on missing them
+#define STEP_REFRACTORY_FRACTION 0.6f
+#define STEP_REFRACTORY_MS 250
+#define STEP_REFRACTORY_MAX_MS 400
+
+// a longer gap between two steps is a pause, it doesn't say anything about the pace
+#define STEP_MAX_GAP_MS 2000
+
+typedef struct StepEvent {
+  uint32_t index;  // sample the rise started at (ImuSample::index)
+  float peak;      // highest magnitude during it, in g
+} StepEvent;
+
+// counters to check from the serial monitor how the detector is doing
+typedef struct StepDetectorStats {
+  unsigned long samples = 0;
+  unsigned long steps = 0;
+  unsigned long refractory = 0;  // rises ignored for coming too soon after a step
+  long readyIndex = -1;          // sample the detector started counting at
+} StepDetectorStats;
+
+class StepDetector {
+public:
+  // runs a block of samples (and their squared magnitudes from accelSquaredMagnitudes()) through the detector,
+  // fills events with the steps that ended in it (at most n) and returns how many
+  size_t feed(const ImuSample *samples, const uint32_t *squared, size_t n, StepEvent *events);
+
+  // back to no statistics, for when the sample stream restarts
+  void reset();
+
+  bool ready() const { return counters.readyIndex >= 0; }
+
+  // the magnitude's mean and standard deviation in g, as the squared statistics put them
+  float mean() const;
+  float sd() const;
+
+  const StepDetectorStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  void update(uint32_t squared);
+
+  // of the squared magnitudes >> STEP_SQUARED_SHIFT
+  int64_t average = 0;
+  int64_t variance = 0;
+  unsigned long seen = 0;
+
+  bool rising = false;   // between a rise and the fall that ends it
+  bool counted = false;  // whether that rise is a step (not inside the refractory window)
+  uint32_t riseIndex = 0;
+  uint32_t peakSquared = 0;
+  bool stepped = false;  // there's a last step for the refractory window
+  uint32_t lastStepIndex = 0;
+  float stepGap = 0;     // running average of the samples between steps, 0 until there are two in a row
+
+  StepDetectorStats counters;
+};
+
+#endif
@@ -0,0 +1,253 @@
+#include "Uplink.h"
+
+Uplink::Uplink(Client &client, const IPAddress &server, uint16_t port, const char *hostName,
+               unsigned long timeout)
+  : client(client), serverAddr(server), serverPort(port), host(hostName), timeout(timeout) {
+  bodyBuf[0] = '\0';
+}
+
+bool Uplink::get(const char *path) {
+  return send("GET", path, NULL, NULL, 0);
+}
+
+bool Uplink::post(const char *path, const char *contentType, const char *body, size_t bodyLen) {
+  return send("POST", path, contentType, body, bodyLen);
+}
+
+bool Uplink::send(const char *method, const char *path, const char *contentType, const char *body, size_t bodyLen) {
+  // can't write more requests than we can keep time stamps for, caller needs to read a response first
+  if (pendingCount >= UPLINK_MAX_PIPELINE) {
+    return false;
+  }
+
+  char header[384];
+  int len;
+  if (body != NULL) {
+    len = snprintf(header, sizeof(header),
+                   "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n"
+                   "Content-Type: %s\r\nContent-Length: %u\r\n\r\n",
+                   method, path, host, contentType, (unsigned) bodyLen);
+  } else {
+    len = snprintf(header, sizeof(header),
+                   "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n", method, path, host);
+  }
+  if (len < 0 || len >= (int) sizeof(header)) {
+    return false;
+  }
+
+  // try on the open connection first, if the server dropped it reconnect once and resend
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (client.connected()) {
+      counters.reused++;
+    } else if (!connect()) {
+      return false;
+    }
+
+    bool written = client.write((const uint8_t *) header, len) == (size_t) len;
+    if (written && bodyLen > 0) {
+      written = client.write((const uint8_t *) body, bodyLen) == bodyLen;
+    }
+
+    if (written) {
+      // the response timeout starts now if nothing else is ahead of this request
+      if (pendingCount == 0) {
+        lastActivity = millis();
+      }
+      sentAt[(pendingHead + pendingCount) % UPLINK_MAX_PIPELINE] = millis();
+      pendingCount++;
+      counters.requests++;
+      return true;
+    }
+
+    fail();
+  }
+  return false;
+}
+
+int Uplink::poll() {
+  unsigned long start = micros();
+  int result = parse();
+
+  // keep track of the worst case so we can see the uplink never stalls loop()
+  unsigned long spent = micros() - start;
+  if (spent > counters.maxPollUs) {
+    counters.maxPollUs = spent;
+  }
+  return result;
+}
+
+int Uplink::parse() {
+  if (pendingCount == 0) {
+    return UPLINK_WAITING;
+  }
+
+  // only handle a few chunks per call so one big response can't hog loop() either
+  for (int chunk = 0; chunk < 4; chunk++) {
+    if (rxPos == rxLen) {
+      int available = client.available();
+      if (available <= 0) {
+        break;
+      }
+      int n = client.read(rx, min((size_t) available, sizeof(rx)));
+      if (n <= 0) {
+        break;
+      }
+      rxPos = 0;
+      rxLen = n;
+      lastActivity = millis();
+    }
+
+    while (rxPos < rxLen) {
+      if (state == BODY) {
+        // take the body in one go, but never past Content-Length since the rest is the next response
+        size_t n = rxLen - rxPos;
+        if (remaining >= 0 && (long) n > remaining) {
+          n = remaining;
+        }
+        size_t room = sizeof(bodyBuf) - 1 - bodyLen;
+        memcpy(bodyBuf + bodyLen, rx + rxPos, min(n, room));
+        bodyLen += min(n, room);
+        rxPos += n;
+
+        if (remaining >= 0) {
+          remaining -= n;
+          if (remaining == 0) {
+            return finishResponse();
+          }
+        }
+      } else {
+        char c = rx[rxPos++];
+        if (c == '\n') {
+          int result = handleLine();
+          if (result != UPLINK_WAITING) {
+            return result;
+          }
+        } else if (c != '\r' && lineLen < sizeof(line) - 1) {
+          line[lineLen++] = c;
+        }
+      }
+    }
+  }
+
+  // nothing left to read right now, check if the server hung up or is taking too long
+  if (rxPos == rxLen && !client.connected() && client.available() <= 0) {
+    // without a Content-Length the body only ends when the server closes the connection
+    if (state == BODY && remaining < 0) {
+      return finishResponse();
+    }
+    fail();
+    return UPLINK_ERROR_CONNECTION_FAILED;
+  }
+  if (millis() - lastActivity >= timeout) {
+    fail();
+    return UPLINK_ERROR_TIMED_OUT;
+  }
+  return UPLINK_WAITING;
+}
+
+// handles one complete status/header line
+int Uplink::handleLine() {
+  line[lineLen] = '\0';
+  lineLen = 0;
+
+  if (state == STATUS_LINE) {
+    // status line looks like "HTTP/1.1 200 OK"
+    char *code = strchr(line, ' ');
+    if (strncmp(line, "HTTP/", 5) != 0 || code == NULL) {
+      fail();
+      return UPLINK_ERROR_INVALID_RESPONSE;
+    }
+    status = atoi(code + 1);
+    state = HEADERS;
+  } else if (line[0] == '\0') {
+    // blank line ends the headers
+    if (remaining == 0) {
+      return finishResponse();
+    }
+    state = BODY;
+  } else if (strncasecmp(line, "Content-Length:", 15) == 0) {
+    // only care about the body length and whether the server wants to close the connection
+    remaining = atol(line + 15);
+  } else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line + 11, "close") != NULL) {
+    closeAfter = true;
+  }
+  return UPLINK_WAITING;
+}
+
+// response is done, update round trip counters using the oldest outstanding request
+int Uplink::finishResponse() {
+  int result = status;
+  bodyBuf[bodyLen] = '\0';
+
+  unsigned long rtt = millis() - sentAt[pendingHead];
+  pendingHead = (pendingHead + 1) % UPLINK_MAX_PIPELINE;
+  pendingCount--;
+
+  counters.responses++;
+  counters.lastRtt = rtt;
+  counters.totalRtt += rtt;
+  if (counters.responses == 1 || rtt < counters.minRtt) {
+    counters.minRtt = rtt;
+  }
+  if (rtt > counters.maxRtt) {
+    counters.maxRtt = rtt;
+  }
+
+  if (closeAfter || remaining < 0) {
+    // anything still pipelined behind this response is lost with the connection
+    counters.failures += pendingCount;
+    stop();
+  } else {
+    resetParser();
+  }
+
+  // the next response's timeout starts now
+  lastActivity = millis();
+
+  return result;
+}
+
+void Uplink::stop() {
+  client.stop();
+  pendingHead = 0;
+  pendingCount = 0;
+  rxPos = 0;
+  rxLen = 0;
+  resetParser();
+}
+
+void Uplink::resetParser() {
+  state = STATUS_LINE;
+  lineLen = 0;
+  status = 0;
+  remaining = -1;
+  closeAfter = false;
+  bodyLen = 0;
+}
+
+void Uplink::printStats(Print &out) const {
+  unsigned long avgRtt = counters.responses > 0 ? counters.totalRtt / counters.responses : 0;
+  out.printf("Uplink: %lu requests, %lu responses, %lu connects, %lu reused, %lu failures\n",
+             counters.requests, counters.responses, counters.connects, counters.reused, counters.failures);
+  out.printf("Uplink RTT (ms): last %lu, min %lu, avg %lu, max %lu / longest poll: %lu us\n",
+             counters.lastRtt, counters.minRtt, avgRtt, counters.maxRtt, counters.maxPollUs);
+}
+
+bool Uplink::connect() {
+  // requests still waiting on the old connection won't get an answer anymore
+  counters.failures += pendingCount;
+  stop();
+
+  if (!client.connect(serverAddr, serverPort)) {
+    counters.failures++;
+    return false;
+  }
+  counters.connects++;
+  return true;
+}
+
+// drops the connection after an error, any pipelined requests on it are lost
+void Uplink::fail() {
+  counters.failures += pendingCount > 0 ? pendingCount : 1;
+  stop();
+}
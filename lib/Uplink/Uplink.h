@@ -0,0 +1,113 @@
+// Uplink - keeps one HTTP/1.1 keep-alive connection open to the cloud server and reuses it for every
+// sample instead of doing a TCP handshake/teardown per reading (shared by Lab 3 and the Final Project devkitV1)
+//
+// Responses are read without blocking: call poll() from loop() and it only handles whatever bytes have
+// already arrived, so a slow server never holds up the rest of the firmware
+
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <IPAddress.h>
+
+// poll() returns this while a response is still on its way (or nothing was requested)
+#define UPLINK_WAITING 0
+
+// error codes returned in place of a status code (same idea as the HttpClient lib)
+#define UPLINK_ERROR_CONNECTION_FAILED -1
+#define UPLINK_ERROR_TIMED_OUT         -3
+#define UPLINK_ERROR_INVALID_RESPONSE  -4
+
+// how many requests can be written before their responses have been read
+#define UPLINK_MAX_PIPELINE 4
+
+// how much of each response body is kept (the rest is read and thrown away)
+#define UPLINK_BODY_SIZE 128
+
+// counters so connection reuse and round trip times can be checked from the serial monitor
+typedef struct UplinkStats {
+  unsigned long requests = 0;   // requests written to the server
+  unsigned long responses = 0;  // responses fully read
+  unsigned long connects = 0;   // TCP connections opened (1 means every request reused the first one)
+  unsigned long reused = 0;     // requests sent on an already open connection
+  unsigned long failures = 0;   // requests/responses that failed and dropped the connection
+  unsigned long lastRtt = 0;    // ms from writing a request to finishing its response
+  unsigned long minRtt = 0;
+  unsigned long maxRtt = 0;
+  unsigned long totalRtt = 0;   // used for the average
+  unsigned long maxPollUs = 0;  // longest single poll() call, i.e. the most time the uplink took out of loop()
+} UplinkStats;
+
+class Uplink {
+public:
+  Uplink(Client &client, const IPAddress &server, uint16_t port, const char *hostName,
+         unsigned long timeout = 30*1000);
+
+  // writes a GET request for path (the bit after the hostname in the URL), reconnecting only if the
+  // connection has dropped. Several requests can be written before reading responses (pipelining)
+  bool get(const char *path);
+
+  // same as get() but sends body with a POST (used for batched samples)
+  bool post(const char *path, const char *contentType, const char *body, size_t bodyLen);
+
+  // reads whatever part of the next response has arrived and returns right away. Returns UPLINK_WAITING until
+  // the response is complete, then its HTTP status code (body() holds the body) or one of the UPLINK_ERROR codes
+  int poll();
+
+  // body of the response poll() last finished (NUL terminated, cut off at UPLINK_BODY_SIZE - 1 chars)
+  const char *body() const { return bodyBuf; }
+
+  // closes the connection, the next request will open a new one
+  void stop();
+
+  uint8_t pending() const { return pendingCount; }
+  const UplinkStats &stats() const { return counters; }
+  void printStats(Print &out) const;
+
+private:
+  enum ParseState {
+    STATUS_LINE,
+    HEADERS,
+    BODY
+  };
+
+  bool send(const char *method, const char *path, const char *contentType, const char *body, size_t bodyLen);
+  bool connect();
+  void fail();
+  void resetParser();
+  int parse();
+  int handleLine();
+  int finishResponse();
+
+  Client &client;
+  IPAddress serverAddr;
+  uint16_t serverPort;
+  const char *host;
+  unsigned long timeout;
+
+  // time stamps of requests that are still waiting for a response (oldest first)
+  unsigned long sentAt[UPLINK_MAX_PIPELINE];
+  uint8_t pendingHead = 0;
+  uint8_t pendingCount = 0;
+
+  // bytes read from the client but not parsed yet (may already belong to the next pipelined response)
+  uint8_t rx[128];
+  uint8_t rxPos = 0;
+  uint8_t rxLen = 0;
+
+  // state of the response currently being parsed
+  ParseState state = STATUS_LINE;
+  char line[128];
+  uint8_t lineLen = 0;
+  int status = 0;
+  long remaining = -1;      // body bytes left, -1 = no Content-Length so read until the server closes
+  bool closeAfter = false;
+  char bodyBuf[UPLINK_BODY_SIZE];
+  size_t bodyLen = 0;
+  unsigned long lastActivity = 0;
+
+  UplinkStats counters;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include "VehicleFrame.h"
+#include <string.h>
+
+uint16_t frameCrc(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t) data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+void sealFrame(vehicle_frame &frame) {
+  frame.version = VEHICLE_FRAME_VERSION;
+  frame.crc = frameCrc((const uint8_t *) &frame, offsetof(vehicle_frame, crc));
+}
+
+FrameError openFrame(const uint8_t *data, int len, vehicle_frame &frame) {
+  if (len != (int) sizeof(vehicle_frame)) {
+    return FRAME_BAD_LENGTH;
+  }
+  // version is always the first byte, so check it before trusting the rest of the layout
+  if (data[0] != VEHICLE_FRAME_VERSION) {
+    return FRAME_BAD_VERSION;
+  }
+
+  memcpy(&frame, data, sizeof(vehicle_frame));
+  if (frame.crc != frameCrc(data, offsetof(vehicle_frame, crc))) {
+    return FRAME_BAD_CRC;
+  }
+  return FRAME_OK;
+}
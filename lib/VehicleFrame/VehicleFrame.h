@@ -0,0 +1,50 @@
+// VehicleFrame - the ESP-NOW frame the TTGO sends and the devkitV1 receives. Both sides include this
+// header so the layout can't drift apart like the two hand copied structs could
+
+#ifndef VEHICLE_FRAME_H
+#define VEHICLE_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bump this whenever the layout below changes, the receiver drops frames with a different version
+#define VEHICLE_FRAME_VERSION 1
+
+// bits in vehicle_frame.lights (set = light ON)
+#define LIGHT_ENGINE  (1 << 0)
+#define LIGHT_TIRE    (1 << 1)
+#define LIGHT_OIL     (1 << 2)
+#define LIGHT_BATTERY (1 << 3)
+
+// packed so it's the same bytes on both ESP32s (both little endian), 11 bytes instead of the old 20 byte struct
+typedef struct __attribute__((packed)) vehicle_frame {
+  uint8_t version;     // VEHICLE_FRAME_VERSION
+  uint8_t lights;      // LIGHT_* bitmask
+  uint8_t speed;       // 0-100 mph
+  uint16_t sequence;   // counts up with every frame sent (wraps around)
+  uint32_t timestamp;  // millis() on the TTGO when it was sent
+  uint16_t crc;        // CRC-16/CCITT of every byte before it
+} vehicle_frame;
+
+static_assert(sizeof(vehicle_frame) == 11, "vehicle_frame layout changed, bump VEHICLE_FRAME_VERSION");
+static_assert(offsetof(vehicle_frame, crc) == sizeof(vehicle_frame) - sizeof(uint16_t),
+              "crc has to be the last field so it can cover everything before it");
+
+// reasons a received frame was thrown away
+enum FrameError {
+  FRAME_OK = 0,
+  FRAME_BAD_LENGTH,
+  FRAME_BAD_VERSION,
+  FRAME_BAD_CRC
+};
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+uint16_t frameCrc(const uint8_t *data, size_t len);
+
+// fills in the version and crc right before the frame is sent
+void sealFrame(vehicle_frame &frame);
+
+// checks length, version and crc of received bytes and copies them into frame if they're good
+FrameError openFrame(const uint8_t *data, int len, vehicle_frame &frame);
+
+#endif
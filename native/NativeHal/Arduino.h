@@ -0,0 +1,83 @@
+// NativeHal - stand-ins for the Arduino/ESP32 APIs the final project firmwares (and Labs 3-5) use, so
+// TTGO/main.cpp, DevkitV1/main.cpp and the lab sketches can be built with the PlatformIO native platform and run
+// as normal Linux processes
+//
+// Only what the firmwares actually call is implemented. Behaviour is controlled with environment variables
+// (see NativeHal.cpp) and button/potentiometer input comes in on stdin
+
+#ifndef NATIVE_HAL_ARDUINO_H
+#define NATIVE_HAL_ARDUINO_H
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "WString.h"
+#include "Print.h"
+
+using std::min;
+using std::max;
+
+#define LOW  0
+#define HIGH 1
+
+#define INPUT        0x01
+#define OUTPUT       0x03
+#define INPUT_PULLUP 0x05
+
+// interrupt modes
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+// ISRs don't need to live in IRAM on Linux
+#define IRAM_ATTR
+
+typedef enum {
+  GPIO_NUM_0 = 0, GPIO_NUM_1, GPIO_NUM_2, GPIO_NUM_3, GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_6, GPIO_NUM_7,
+  GPIO_NUM_8, GPIO_NUM_9, GPIO_NUM_10, GPIO_NUM_11, GPIO_NUM_12, GPIO_NUM_13, GPIO_NUM_14, GPIO_NUM_15,
+  GPIO_NUM_16, GPIO_NUM_17, GPIO_NUM_18, GPIO_NUM_19, GPIO_NUM_20, GPIO_NUM_21, GPIO_NUM_22, GPIO_NUM_23,
+  GPIO_NUM_24, GPIO_NUM_25, GPIO_NUM_26, GPIO_NUM_27, GPIO_NUM_28, GPIO_NUM_29, GPIO_NUM_30, GPIO_NUM_31,
+  GPIO_NUM_32, GPIO_NUM_33, GPIO_NUM_34, GPIO_NUM_35, GPIO_NUM_36, GPIO_NUM_37, GPIO_NUM_38, GPIO_NUM_39,
+  GPIO_NUM_MAX
+} gpio_num_t;
+
+typedef int esp_err_t;
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+// time since the process started, like time since boot on the ESP32
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+// pins: outputs are logged, inputs come from stdin commands ("press <pin>", "analog <pin> <0-4095>")
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+// edges from "press" commands call the handler on the input thread, like a GPIO ISR interrupting loop()
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+// firmware entry points, NativeHal.cpp provides main() that calls these like the ESP32 core does
+void setup();
+void loop();
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  void flush();
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,10 @@
+// NativeHal - client characteristic configuration descriptor, nothing to configure without a phone
+
+#ifndef NATIVE_HAL_BLE2902_H
+#define NATIVE_HAL_BLE2902_H
+
+#include "BLEDevice.h"
+
+class BLE2902 : public BLEDescriptor {};
+
+#endif
@@ -0,0 +1,82 @@
+// NativeHal - just enough of the ESP32 BLE server API for the Lab 4/5 step counters: one characteristic that
+// prints every notify() (phones aren't simulated) and takes writes from the "ble" stdin command
+
+#ifndef NATIVE_HAL_BLE_DEVICE_H
+#define NATIVE_HAL_BLE_DEVICE_H
+
+#include "Arduino.h"
+
+#include <string>
+#include <vector>
+
+class BLEUUID {
+public:
+  BLEUUID(const char *uuid) : uuid(uuid) {}
+  std::string uuid;
+};
+
+class BLEDescriptor {
+public:
+  virtual ~BLEDescriptor() {}
+};
+
+class BLECharacteristic;
+
+class BLECharacteristicCallbacks {
+public:
+  virtual ~BLECharacteristicCallbacks() {}
+  virtual void onWrite(BLECharacteristic *pCharacteristic) {}
+};
+
+class BLECharacteristic {
+public:
+  static const uint32_t PROPERTY_READ = 1 << 0;
+  static const uint32_t PROPERTY_WRITE = 1 << 1;
+  static const uint32_t PROPERTY_NOTIFY = 1 << 2;
+
+  BLECharacteristic(BLEUUID uuid, uint32_t properties) : uuid(uuid), properties(properties) {}
+
+  void setCallbacks(BLECharacteristicCallbacks *callbacks) { this->callbacks = callbacks; }
+  void addDescriptor(BLEDescriptor *descriptor) {}
+  void setValue(const std::string &value) { this->value = value; }
+  void setValue(const String &value) { this->value = value.c_str(); }
+  std::string getValue() { return value; }
+  void notify();
+
+  // what a connected phone writing value would do
+  void written(const std::string &value);
+
+private:
+  BLEUUID uuid;
+  uint32_t properties;
+  std::string value;
+  BLECharacteristicCallbacks *callbacks = NULL;
+};
+
+class BLEService {
+public:
+  BLECharacteristic *createCharacteristic(const char *uuid, uint32_t properties);
+  void start() {}
+};
+
+class BLEAdvertising {
+public:
+  void start();
+};
+
+class BLEServer {
+public:
+  BLEService *createService(const char *uuid) { return new BLEService(); }
+  BLEAdvertising *getAdvertising() { return &advertising; }
+
+private:
+  BLEAdvertising advertising;
+};
+
+class BLEDevice {
+public:
+  static void init(const std::string &name);
+  static BLEServer *createServer() { return new BLEServer(); }
+};
+
+#endif
@@ -0,0 +1,22 @@
+// NativeHal - Arduino Client interface (what Uplink talks to)
+
+#ifndef NATIVE_HAL_CLIENT_H
+#define NATIVE_HAL_CLIENT_H
+
+#include "Print.h"
+#include "IPAddress.h"
+
+class Client : public Print {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  using Print::write;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t *buffer, size_t size) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+};
+
+#endif
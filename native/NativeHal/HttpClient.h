@@ -0,0 +1,49 @@
+// NativeHal - the part of the Arduino HttpClient library the firmwares used before lib/Uplink (one request per
+// connection, "Connection: close"), so the old versions can still be built and timed against the new ones.
+// Like the library, it waits for the response in steps of HTTP_WAIT_FOR_DATA_DELAY ms while nothing has arrived
+
+#ifndef NATIVE_HAL_HTTP_CLIENT_H
+#define NATIVE_HAL_HTTP_CLIENT_H
+
+#include "Arduino.h"
+#include "Client.h"
+#include "IPAddress.h"
+
+#define HTTP_SUCCESS 0
+#define HTTP_ERROR_CONNECTION_FAILED -1
+#define HTTP_ERROR_TIMED_OUT -3
+#define HTTP_ERROR_INVALID_RESPONSE -4
+
+#define HTTP_WAIT_FOR_DATA_DELAY 1000
+#define HTTP_RESPONSE_TIMEOUT 30000
+
+class HttpClient {
+public:
+  HttpClient(Client &client) : client(client) {}
+
+  // connects and writes the request, HTTP_SUCCESS or an error
+  int get(IPAddress server, const char *hostName, uint16_t port, const char *path);
+
+  // blocks until the status line is in, the status code or an error
+  int responseStatusCode();
+
+  // blocks until the blank line after the headers, HTTP_SUCCESS or an error
+  int skipResponseHeaders();
+
+  // from the Content-Length header, -1 if there wasn't one
+  int contentLength() const { return length; }
+
+  int available() { return client.available(); }
+  int read() { return client.read(); }
+  bool connected() { return client.connected(); }
+  void stop() { client.stop(); }
+
+private:
+  // next byte of the response, waiting for it like the library does. -1 on a timeout or a closed connection
+  int nextByte();
+
+  Client &client;
+  int length = -1;
+};
+
+#endif
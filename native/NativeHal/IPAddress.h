@@ -0,0 +1,25 @@
+// NativeHal - Arduino IPAddress (IPv4 only)
+
+#ifndef NATIVE_HAL_IPADDRESS_H
+#define NATIVE_HAL_IPADDRESS_H
+
+#include <stdint.h>
+
+#include "WString.h"
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : bytes{a, b, c, d} {}
+
+  uint8_t operator[](int i) const { return bytes[i]; }
+
+  String toString() const {
+    return String((unsigned) bytes[0]) + "." + String((unsigned) bytes[1]) + "." +
+           String((unsigned) bytes[2]) + "." + String((unsigned) bytes[3]);
+  }
+
+private:
+  uint8_t bytes[4];
+};
+
+#endif
@@ -0,0 +1,1339 @@
+// NativeHal - Linux implementations of the stand-ins declared in the other headers
+//
+// Environment variables:
+//   NATIVE_MAC=aa:bb:cc:dd:ee:ff   this device's MAC (picks its ESP-NOW UDP port), default 02:00:00:00:00:01
+//   NATIVE_CHANNEL=6               channel reported for the AP and scans
+//   NATIVE_SSID=native             the one network scans find (matches the placeholder secrets.h)
+//   NATIVE_SERVER=127.0.0.1:8080   redirect every WiFiClient connection here
+//   NATIVE_ESPNOW_LOSS=0.1         fraction of ESP-NOW frames to drop
+//   NATIVE_ADC_NOISE=40            +/- this many counts of random noise on every ADC reading
+//   NATIVE_FLASH=flash.bin         file holding the flash partition (kept between runs like real flash)
+//   NATIVE_WIFI_JOIN_MS=0          how long WiFi.begin takes to associate and get an address (0 = at once)
+//
+// stdin commands (one per line):
+//   press <pin>                    holds an INPUT_PULLUP button LOW for 30 ms (the edges bounce for ~1 ms
+//                                  at both ends, interrupts attached to the pin see every one of them)
+//   analog <pin> <0-4095>          sets what analogRead returns for that pin
+//   wifi off / wifi on             drops the WiFi connection (open connections fail, new ones are refused)
+//                                  and brings it back
+//   imu still|walk|jump            what the simulated LSM6DSO feels from now on: lying still, a step every
+//                                  0.55 s (heel strikes from 0.5 to 0.9 g), or a jump every 1.6 s. Its
+//                                  embedded pedometer counts the steps too, if it's turned on
+//   ble <value>                    a phone writing value to the (last created) writable BLE characteristic
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "driver/i2s.h"
+#include "esp_partition.h"
+#include "esp_sleep.h"
+#include "Wire.h"
+#include "BLEDevice.h"
+#include "HttpClient.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+TwoWire Wire;
+
+// cleared by "wifi off", see WiFiClass
+static std::atomic<bool> wifiUp{true};
+
+// set by "imu", see the LSM6DSO under I2C
+#define IMU_STILL 0
+#define IMU_WALK  1
+#define IMU_JUMP  2
+static std::atomic<int> imuMotion{IMU_STILL};
+
+// the simulated LSM6DSO's INT1, wired to GPIO 34 like in Labs 4 and 5 (digitalRead and light sleep see it)
+#define LSM6DSO_INT1_PIN 34
+static std::atomic<bool> imuInt1{false};
+
+// what "ble" writes to, see BLECharacteristic
+static std::atomic<BLECharacteristic *> bleCharacteristic{NULL};
+
+// ******** TIME ********
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+// wall clock ms, printed with input/output events so logs from several processes can be lined up
+static unsigned long long wallMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ******** SERIAL ********
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+// ******** PINS ********
+
+static std::atomic<unsigned long> pressedUntil[GPIO_NUM_MAX];
+static std::atomic<uint16_t> analogValues[GPIO_NUM_MAX];
+
+typedef struct pin_interrupt {
+  void (*handler)(void *) = NULL;
+  void *arg = NULL;
+  int mode = 0;
+} pin_interrupt;
+
+static std::mutex interruptMutex;
+static pin_interrupt interrupts[GPIO_NUM_MAX];
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  fprintf(stderr, "[hal] %llu pin %u = %u\n", wallMillis(), pin, value);
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin == LSM6DSO_INT1_PIN) {
+    return imuInt1 ? HIGH : LOW;
+  }
+  // buttons are wired to ground with a pullup, so pressed reads LOW
+  return pin < GPIO_NUM_MAX && millis() < pressedUntil[pin] ? LOW : HIGH;
+}
+
+// what the ADC reads on a pin right now: the value set with "analog" plus NATIVE_ADC_NOISE
+static uint16_t adcSample(uint8_t pin) {
+  static const int noise = atoi(getenv("NATIVE_ADC_NOISE") != NULL ? getenv("NATIVE_ADC_NOISE") : "0");
+  thread_local std::mt19937 noiseRandom(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+  int value = pin < GPIO_NUM_MAX ? analogValues[pin].load() : 0;
+  if (noise > 0) {
+    value += std::uniform_int_distribution<int>(-noise, noise)(noiseRandom);
+  }
+  return (uint16_t) std::min(std::max(value, 0), 4095);
+}
+
+uint16_t analogRead(uint8_t pin) {
+  // a single-shot conversion takes ~10 us on the ESP32, spin for it like the real call does
+  unsigned long start = micros();
+  while (micros() - start < 10) {
+  }
+  return adcSample(pin);
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode) {
+  if (pin < GPIO_NUM_MAX) {
+    std::lock_guard<std::mutex> lock(interruptMutex);
+    interrupts[pin].handler = handler;
+    interrupts[pin].arg = arg;
+    interrupts[pin].mode = mode;
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < GPIO_NUM_MAX) {
+    std::lock_guard<std::mutex> lock(interruptMutex);
+    interrupts[pin].handler = NULL;
+  }
+}
+
+// runs the pin's handler if it's attached for this kind of edge (interrupts don't nest, hence the lock)
+static void fireEdge(uint8_t pin, bool rising) {
+  std::lock_guard<std::mutex> lock(interruptMutex);
+  const pin_interrupt &irq = interrupts[pin];
+  if (irq.handler != NULL && (irq.mode & (rising ? RISING : FALLING)) != 0) {
+    irq.handler(irq.arg);
+  }
+}
+
+// a mechanical button doesn't switch cleanly: falling edge, a bounce back up and down, then the same on release
+static void bouncePress(uint8_t pin) {
+  fireEdge(pin, false);
+  usleep(300);
+  fireEdge(pin, true);
+  usleep(300);
+  fireEdge(pin, false);
+
+  std::thread([pin]() {
+    while (millis() < pressedUntil[pin]) {
+      delay(1);
+    }
+    fireEdge(pin, true);
+    usleep(300);
+    fireEdge(pin, false);
+    usleep(300);
+    fireEdge(pin, true);
+  }).detach();
+}
+
+// reads "press"/"analog"/"wifi"/"imu"/"ble" commands from stdin so a script can drive the inputs
+static void inputThread() {
+  std::string command;
+  while (std::cin >> command) {
+    unsigned pin = 0;
+    unsigned value = 0;
+    if (command == "press" && std::cin >> pin && pin < GPIO_NUM_MAX) {
+      pressedUntil[pin] = millis() + 30;
+      fprintf(stderr, "[hal] %llu press %u\n", wallMillis(), pin);
+      bouncePress(pin);
+    } else if (command == "analog" && std::cin >> pin >> value && pin < GPIO_NUM_MAX) {
+      analogValues[pin] = min(value, 4095u);
+    } else if (command == "wifi" && std::cin >> command) {
+      wifiUp = command != "off";
+      fprintf(stderr, "[hal] %llu wifi %s\n", wallMillis(), wifiUp ? "on" : "off");
+    } else if (command == "imu" && std::cin >> command) {
+      imuMotion = command == "walk" ? IMU_WALK : command == "jump" ? IMU_JUMP : IMU_STILL;
+      fprintf(stderr, "[hal] %llu imu %s\n", wallMillis(), command.c_str());
+    } else if (command == "ble" && std::cin >> command && bleCharacteristic != NULL) {
+      bleCharacteristic.load()->written(command);
+    }
+  }
+}
+
+// ******** TIMERS ********
+
+struct esp_timer {
+  esp_timer_create_args_t args;
+  bool active = false;
+  int64_t deadlineUs = 0;
+  uint64_t periodUs = 0;  // 0 = one-shot
+};
+
+static std::mutex timerMutex;
+static std::condition_variable timerWake;
+static std::vector<esp_timer *> timers;
+
+// plays the part of the esp_timer task: runs due callbacks one after another
+static void timerThread() {
+  std::unique_lock<std::mutex> lock(timerMutex);
+  while (true) {
+    esp_timer *next = NULL;
+    for (size_t i = 0; i < timers.size(); i++) {
+      if (timers[i]->active && (next == NULL || timers[i]->deadlineUs < next->deadlineUs)) {
+        next = timers[i];
+      }
+    }
+
+    if (next == NULL) {
+      timerWake.wait(lock);
+      continue;
+    }
+    int64_t now = esp_timer_get_time();
+    if (now < next->deadlineUs) {
+      timerWake.wait_for(lock, std::chrono::microseconds(next->deadlineUs - now));
+      continue;
+    }
+
+    if (next->periodUs > 0) {
+      next->deadlineUs += next->periodUs;
+    } else {
+      next->active = false;
+    }
+    esp_timer_create_args_t args = next->args;
+    lock.unlock();
+    args.callback(args.arg);
+    lock.lock();
+  }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out) {
+  if (args == NULL || args->callback == NULL || out == NULL) {
+    return ESP_FAIL;
+  }
+
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (timers.empty()) {
+    std::thread(timerThread).detach();
+  }
+  esp_timer *timer = new esp_timer();
+  timer->args = *args;
+  timers.push_back(timer);
+  *out = timer;
+  return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t timeoutUs, uint64_t periodUs) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = true;
+  timer->deadlineUs = esp_timer_get_time() + timeoutUs;
+  timer->periodUs = periodUs;
+  timerWake.notify_one();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  return startTimer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+  return startTimer(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (!timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = false;
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  return timer->active;
+}
+
+int64_t esp_timer_get_time() {
+  return micros();
+}
+
+// ******** SEMAPHORES ********
+
+struct native_semaphore {
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool given = false;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return new native_semaphore();
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  std::lock_guard<std::mutex> lock(sem->mutex);
+  if (sem->given) {
+    return pdFALSE;
+  }
+  sem->given = true;
+  sem->cond.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *higherPriorityTaskWoken) {
+  if (higherPriorityTaskWoken != NULL) {
+    *higherPriorityTaskWoken = pdFALSE;
+  }
+  return xSemaphoreGive(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(sem->mutex);
+  if (ticks == portMAX_DELAY) {
+    sem->cond.wait(lock, [sem]() { return sem->given; });
+  } else if (!sem->cond.wait_for(lock, std::chrono::milliseconds(ticks), [sem]() { return sem->given; })) {
+    return pdFALSE;
+  }
+  sem->given = false;
+  return pdTRUE;
+}
+
+// ******** TASKS ********
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  std::thread(fn, param).detach();
+  if (handle != NULL) {
+    *handle = NULL;
+  }
+  return pdPASS;
+}
+
+// ******** LIGHT SLEEP ********
+
+static std::atomic<uint64_t> sleepTimerUs{0};    // 0 = no timer wake-up
+static std::atomic<bool> sleepGpio{false};
+static std::atomic<int> wakeLevels[GPIO_NUM_MAX];  // level + 1 that wakes the chip, 0 = not a wake-up source
+static std::atomic<int> wakeCause{ESP_SLEEP_WAKEUP_UNDEFINED};
+
+esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t type) {
+  if (pin >= GPIO_NUM_MAX || (type != GPIO_INTR_LOW_LEVEL && type != GPIO_INTR_HIGH_LEVEL)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  wakeLevels[pin] = (type == GPIO_INTR_HIGH_LEVEL ? HIGH : LOW) + 1;
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t pin) {
+  if (pin >= GPIO_NUM_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  wakeLevels[pin] = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+  sleepTimerUs = time_in_us;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() {
+  sleepGpio = true;
+  return ESP_OK;
+}
+
+// the calling thread stops until a wake-up source fires, like the CPU does (timers and other threads carry on,
+// where the real chip would hold them too)
+esp_err_t esp_light_sleep_start() {
+  unsigned long start = micros();
+  while (true) {
+    if (sleepGpio) {
+      for (int pin = 0; pin < GPIO_NUM_MAX; pin++) {
+        if (wakeLevels[pin] != 0 && digitalRead(pin) == wakeLevels[pin] - 1) {
+          wakeCause = ESP_SLEEP_WAKEUP_GPIO;
+          return ESP_OK;
+        }
+      }
+    }
+    if (sleepTimerUs != 0 && micros() - start >= sleepTimerUs) {
+      wakeCause = ESP_SLEEP_WAKEUP_TIMER;
+      return ESP_OK;
+    }
+    usleep(200);
+  }
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return (esp_sleep_wakeup_cause_t) wakeCause.load();
+}
+
+// ******** I2S ADC ********
+
+static const uint8_t adc1Pins[ADC1_CHANNEL_MAX] = {36, 37, 38, 39, 32, 33, 34, 35};
+static std::atomic<int> i2sAdcChannel(-1);
+static uint32_t i2sSampleRate = 0;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *config, int queueSize, void *queue) {
+  if (config == NULL || config->sample_rate == 0 || (config->mode & I2S_MODE_ADC_BUILT_IN) == 0) {
+    return ESP_FAIL;
+  }
+  i2sSampleRate = config->sample_rate;
+  return ESP_OK;
+}
+
+esp_err_t i2s_set_adc_mode(adc_unit_t unit, adc1_channel_t channel) {
+  if (unit != ADC_UNIT_1 || channel >= ADC1_CHANNEL_MAX) {
+    return ESP_FAIL;
+  }
+  i2sAdcChannel = channel;
+  return ESP_OK;
+}
+
+esp_err_t i2s_adc_enable(i2s_port_t port) {
+  return i2sAdcChannel >= 0 && i2sSampleRate > 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t i2s_read(i2s_port_t port, void *dest, size_t size, size_t *bytesRead, TickType_t ticks) {
+  int channel = i2sAdcChannel;
+  if (channel < 0 || dest == NULL) {
+    return ESP_FAIL;
+  }
+
+  // the DMA fills buffers at the sample rate, so a read returns once that many samples' worth of time has passed
+  static int64_t nextUs = esp_timer_get_time();
+  size_t count = size / sizeof(uint16_t);
+  nextUs = std::max(nextUs, esp_timer_get_time() - 100000) + (int64_t) count * 1000000 / i2sSampleRate;
+  int64_t waitUs = nextUs - esp_timer_get_time();
+  if (waitUs > 0) {
+    usleep(waitUs);
+  }
+
+  uint16_t *samples = (uint16_t *) dest;
+  for (size_t i = 0; i < count; i++) {
+    samples[i] = (channel << 12) | adcSample(adc1Pins[channel]);
+  }
+  if (bytesRead != NULL) {
+    *bytesRead = count * sizeof(uint16_t);
+  }
+  return ESP_OK;
+}
+
+// ******** WIFI ********
+
+static String envString(const char *name, const char *fallback) {
+  const char *value = getenv(name);
+  return String(value != NULL ? value : fallback);
+}
+
+static void ownMac(uint8_t mac[6]) {
+  String text = envString("NATIVE_MAC", "02:00:00:00:00:01");
+  unsigned b[6];
+  if (sscanf(text.c_str(), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+    memset(b, 0, sizeof(b));
+  }
+  for (int i = 0; i < 6; i++) {
+    mac[i] = b[i];
+  }
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *pass) {
+  static const unsigned long joinMs = atol(envString("NATIVE_WIFI_JOIN_MS", "0").c_str());
+  this->ssid = ssid;
+  connectedStatus = WL_CONNECTED;
+  connectedAt = millis() + joinMs;
+  return joinMs == 0 ? connectedStatus : WL_DISCONNECTED;
+}
+
+wl_status_t WiFiClass::status() {
+  return wifiUp && (long) (millis() - connectedAt) >= 0 ? connectedStatus : WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  connectedStatus = WL_DISCONNECTED;
+  return true;
+}
+
+int32_t WiFiClass::channel() {
+  return atoi(envString("NATIVE_CHANNEL", "6").c_str());
+}
+
+int16_t WiFiClass::scanNetworks() {
+  return 1;
+}
+
+String WiFiClass::SSID(uint8_t i) {
+  return envString("NATIVE_SSID", "native");
+}
+
+int32_t WiFiClass::channel(uint8_t i) {
+  return channel();
+}
+
+String WiFiClass::macAddress() {
+  uint8_t mac[6];
+  ownMac(mac);
+  char text[18];
+  snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return String(text);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  stop();
+  if (!wifiUp) {
+    return 0;
+  }
+
+  String host = ip.toString();
+  const char *server = getenv("NATIVE_SERVER");
+  if (server != NULL && strchr(server, ':') != NULL) {
+    host = String(std::string(server, strchr(server, ':')));
+    port = atoi(strchr(server, ':') + 1);
+  }
+
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *result = NULL;
+  if (getaddrinfo(host.c_str(), String((unsigned) port).c_str(), &hints, &result) != 0) {
+    return 0;
+  }
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || ::connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+    freeaddrinfo(result);
+    stop();
+    return 0;
+  }
+  freeaddrinfo(result);
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+  if (!wifiUp) {
+    stop();
+    return 0;
+  }
+  size_t written = 0;
+  while (fd >= 0 && written < size) {
+    ssize_t n = send(fd, buffer + written, size - written, MSG_NOSIGNAL);
+    if (n <= 0) {
+      break;
+    }
+    written += n;
+  }
+  return written;
+}
+
+int WiFiClient::available() {
+  int count = 0;
+  if (fd < 0 || !wifiUp || ioctl(fd, FIONREAD, &count) != 0) {
+    return 0;
+  }
+  return count;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+  if (fd < 0 || !wifiUp) {
+    return -1;
+  }
+  ssize_t n = recv(fd, buffer, size, MSG_DONTWAIT);
+  return n > 0 ? (int) n : -1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (!wifiUp) {
+    // the connection doesn't survive the WiFi going away
+    stop();
+  }
+  if (fd < 0) {
+    return 0;
+  }
+  if (available() > 0) {
+    return 1;
+  }
+  // a peek returning 0 means the server closed its side
+  uint8_t c;
+  ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? 1 : 0;
+}
+
+void WiFiClient::stop() {
+  if (fd >= 0) {
+    close(fd);
+  }
+  fd = -1;
+}
+
+// ******** HTTP CLIENT ********
+
+int HttpClient::get(IPAddress server, const char *hostName, uint16_t port, const char *path) {
+  length = -1;
+  if (!client.connect(server, port)) {
+    return HTTP_ERROR_CONNECTION_FAILED;
+  }
+  String request = String("GET ") + path + " HTTP/1.1\r\nHost: " + hostName +
+                   "\r\nUser-Agent: Arduino/2.2.0\r\nConnection: close\r\n\r\n";
+  if (client.write((const uint8_t *) request.c_str(), request.length()) != request.length()) {
+    client.stop();
+    return HTTP_ERROR_CONNECTION_FAILED;
+  }
+  return HTTP_SUCCESS;
+}
+
+int HttpClient::nextByte() {
+  unsigned long start = millis();
+  while (millis() - start < HTTP_RESPONSE_TIMEOUT) {
+    if (client.available() > 0) {
+      return client.read();
+    }
+    if (!client.connected()) {
+      return -1;
+    }
+    delay(HTTP_WAIT_FOR_DATA_DELAY);
+  }
+  return -1;
+}
+
+int HttpClient::responseStatusCode() {
+  std::string line;
+  int c;
+  while ((c = nextByte()) >= 0 && c != '\n') {
+    line += (char) c;
+  }
+  if (c < 0) {
+    return HTTP_ERROR_TIMED_OUT;
+  }
+  if (line.compare(0, 5, "HTTP/") != 0 || line.find(' ') == std::string::npos) {
+    return HTTP_ERROR_INVALID_RESPONSE;
+  }
+  return atoi(line.c_str() + line.find(' ') + 1);
+}
+
+int HttpClient::skipResponseHeaders() {
+  while (true) {
+    std::string line;
+    int c;
+    while ((c = nextByte()) >= 0 && c != '\n') {
+      if (c != '\r') {
+        line += (char) c;
+      }
+    }
+    if (c < 0) {
+      return HTTP_ERROR_TIMED_OUT;
+    }
+    if (line.empty()) {
+      return HTTP_SUCCESS;
+    }
+    if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+      length = atoi(line.c_str() + 15);
+    }
+  }
+}
+
+// ******** ESP-NOW ********
+
+// UDP datagrams are [type][sender mac][data...]
+#define ESPNOW_DATA 'D'
+#define ESPNOW_ACK  'A'
+
+// how long a sender waits for the ack before reporting ESP_NOW_SEND_FAIL
+#define ESPNOW_ACK_TIMEOUT_MS 20
+
+typedef struct pending_send {
+  uint8_t mac[6];
+  unsigned long deadline;
+} pending_send;
+
+static int espnowFd = -1;
+static std::atomic<bool> espnowRunning(false);
+static std::atomic<esp_now_recv_cb_t> recvCallback(NULL);
+static std::atomic<esp_now_send_cb_t> sendCallback(NULL);
+static std::mutex pendingMutex;
+static std::vector<pending_send> pendingSends;
+static double lossRate = 0;
+static std::mt19937 lossRandom(1234);
+
+static uint16_t portForMac(const uint8_t *mac) {
+  return 40000 + (((mac[4] << 8) | mac[5]) % 20000);
+}
+
+static void sendDatagram(uint8_t type, const uint8_t *to, const uint8_t *data, size_t len) {
+  uint8_t packet[1 + 6 + ESP_NOW_MAX_DATA_LEN];
+  packet[0] = type;
+  ownMac(packet + 1);
+  memcpy(packet + 7, data, len);
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(portForMac(to));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sendto(espnowFd, packet, 7 + len, 0, (sockaddr *) &addr, sizeof(addr));
+}
+
+// plays the part of the WiFi task: receives frames/acks and runs the callbacks
+static void espnowThread() {
+  uint8_t packet[1 + 6 + ESP_NOW_MAX_DATA_LEN];
+
+  while (true) {
+    pollfd fds = { espnowFd, POLLIN, 0 };
+    if (poll(&fds, 1, 2) > 0) {
+      ssize_t n = recv(espnowFd, packet, sizeof(packet), 0);
+      if (n >= 7 && espnowRunning) {
+        const uint8_t *from = packet + 1;
+        if (packet[0] == ESPNOW_DATA) {
+          sendDatagram(ESPNOW_ACK, from, NULL, 0);
+          esp_now_recv_cb_t cb = recvCallback;
+          if (cb != NULL) {
+            cb(from, packet + 7, n - 7);
+          }
+        } else if (packet[0] == ESPNOW_ACK) {
+          bool acked = false;
+          {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            for (size_t i = 0; i < pendingSends.size(); i++) {
+              if (memcmp(pendingSends[i].mac, from, 6) == 0) {
+                pendingSends.erase(pendingSends.begin() + i);
+                acked = true;
+                break;
+              }
+            }
+          }
+          esp_now_send_cb_t cb = sendCallback;
+          if (acked && cb != NULL) {
+            cb(from, ESP_NOW_SEND_SUCCESS);
+          }
+        }
+      }
+    }
+
+    // anything not acked in time failed, same as the radio giving up after its retries
+    std::vector<pending_send> expired;
+    {
+      std::lock_guard<std::mutex> lock(pendingMutex);
+      unsigned long now = millis();
+      for (size_t i = 0; i < pendingSends.size();) {
+        if (now >= pendingSends[i].deadline) {
+          expired.push_back(pendingSends[i]);
+          pendingSends.erase(pendingSends.begin() + i);
+        } else {
+          i++;
+        }
+      }
+    }
+    esp_now_send_cb_t cb = sendCallback;
+    for (size_t i = 0; i < expired.size() && cb != NULL; i++) {
+      cb(expired[i].mac, ESP_NOW_SEND_FAIL);
+    }
+  }
+}
+
+esp_err_t esp_now_init() {
+  if (espnowFd < 0) {
+    espnowFd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    uint8_t mac[6];
+    ownMac(mac);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(portForMac(mac));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (espnowFd < 0 || bind(espnowFd, (sockaddr *) &addr, sizeof(addr)) != 0) {
+      perror("[hal] esp_now_init");
+      return ESP_FAIL;
+    }
+
+    lossRate = atof(envString("NATIVE_ESPNOW_LOSS", "0").c_str());
+    std::thread(espnowThread).detach();
+  }
+
+  espnowRunning = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_deinit() {
+  espnowRunning = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+  recvCallback = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+  sendCallback = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+  return peer != NULL ? ESP_OK : ESP_ERR_ESPNOW_ARG;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+  if (!espnowRunning) {
+    return ESP_ERR_ESPNOW_NOT_INIT;
+  }
+  if (peer_addr == NULL || len > ESP_NOW_MAX_DATA_LEN) {
+    return ESP_ERR_ESPNOW_ARG;
+  }
+
+  pending_send pending;
+  memcpy(pending.mac, peer_addr, 6);
+  pending.deadline = millis() + ESPNOW_ACK_TIMEOUT_MS;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pendingSends.push_back(pending);
+  }
+
+  // a "lost" frame is simply never sent, so the sender sees the ack time out
+  if (std::uniform_real_distribution<double>(0, 1)(lossRandom) >= lossRate) {
+    sendDatagram(ESPNOW_DATA, peer_addr, data, len);
+  }
+  return ESP_OK;
+}
+
+// ******** I2C ********
+
+#define AHT20_ADDRESS 0x38
+
+// simulated AHT20: when the last conversion was started (0 = never)
+static unsigned long aht20TriggeredMs = 0;
+
+// the 6 bytes of status + humidity + temperature and the CRC-8 an AHT20 answers with
+static void aht20Answer(uint8_t *out) {
+  bool busy = aht20TriggeredMs != 0 && millis() - aht20TriggeredMs < 80;
+  double minutes = millis() / 60000.0;
+  double temperature = 22 + 3 * sin(minutes * 2 * M_PI / 10);
+  double humidity = 45 + 10 * cos(minutes * 2 * M_PI / 10);
+
+  uint32_t rawHumidity = (uint32_t) (humidity / 100 * 1048576);
+  uint32_t rawTemperature = (uint32_t) ((temperature + 50) / 200 * 1048576);
+  out[0] = 0x18 | (busy ? 0x80 : 0);  // calibrated, busy while converting
+  out[1] = rawHumidity >> 12;
+  out[2] = rawHumidity >> 4;
+  out[3] = ((rawHumidity & 0x0F) << 4) | (rawTemperature >> 16);
+  out[4] = rawTemperature >> 8;
+  out[5] = rawTemperature;
+
+  uint8_t crc = 0xFF;
+  for (int i = 0; i < 6; i++) {
+    crc ^= out[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
+  out[6] = crc;
+}
+
+// simulated LSM6DSO: the accelerometer sampled at the data rate set in CTRL1_XL into a continuous-mode FIFO,
+// INT1 rising when the FIFO reaches the watermark. Registers auto-increment, and reading on from the last FIFO
+// output register rolls back to the tag of the next word. FUNC_CFG_ACCESS switches to the embedded function
+// registers, where the pedometer is turned on and its step count read
+#define LSM6DSO_ADDRESS 0x6B
+#define LSM6DSO_FIFO_WORDS 438  // 3 KB of 7 byte words
+
+// the pedometer's step: the magnitude rising past PEDO_RISE_G at least PEDO_MIN_GAP_S after the last one, and
+// dropping back under PEDO_FALL_G before the next can start. Unlike the real one it doesn't debounce
+#define PEDO_RISE_G 1.12
+#define PEDO_FALL_G 1.05
+#define PEDO_MIN_GAP_S 0.3
+
+typedef struct ImuWord {
+  int16_t xyz[3];
+} ImuWord;
+
+static std::mutex imuMutex;
+static uint8_t imuRegs[128];
+static uint8_t imuEmbRegs[128];       // embedded function bank
+static uint8_t imuPointer = 0;
+static std::vector<ImuWord> imuFifo;  // oldest first
+static bool imuOverrun = false;       // FIFO_OVR_LATCHED
+static unsigned long long imuStartUs = 0;
+static unsigned long long imuProduced = 0;  // samples since the data rate or the FIFO mode was last set
+static bool imuStepping = false;            // pedometer: above PEDO_FALL_G since the last step started
+static unsigned long long imuSinceStep = 0; // samples since then
+static bool imuStepInterrupt = false;       // step detector interrupt, latched with PAGE_RW's EMB_FUNC_LIR
+
+static void imuReset() {
+  memset(imuRegs, 0, sizeof(imuRegs));
+  memset(imuEmbRegs, 0, sizeof(imuEmbRegs));
+  imuRegs[0x0F] = 0x6C;  // WHO_AM_I
+  imuRegs[0x12] = 0x04;  // CTRL3_C: IF_INC
+  imuFifo.clear();
+  imuOverrun = false;
+  imuStepping = false;
+  imuSinceStep = ~0ULL >> 1;
+  imuStepInterrupt = false;
+}
+
+// register bank the address goes to, FUNC_CFG_ACCESS itself is in both
+static uint8_t *imuBank(uint8_t reg) {
+  return (imuRegs[0x01] & 0x80) && reg != 0x01 ? imuEmbRegs : imuRegs;
+}
+
+// samples per second for an ODR/BDR code (12.5 Hz doubling up to 6.66 kHz), 0 = off
+static unsigned imuRate(uint8_t code) {
+  return code == 0 || code > 10 ? 0 : 13u << (code - 1);
+}
+
+// what the accelerometer feels at t seconds, in g
+static void imuMotionAt(double t, double *g) {
+  static std::mt19937 noiseRandom(1);
+  std::normal_distribution<double> noise(0, 0.01);
+  g[0] = 0.02 + noise(noiseRandom);
+  g[1] = -0.03 + noise(noiseRandom);
+  g[2] = 1.0 + noise(noiseRandom);
+
+  if (imuMotion == IMU_WALK) {
+    // heel strike (some harder than others), then a smaller push off, the body swaying sideways and jiggling
+    double phase = fmod(t, 0.55);
+    double step = floor(t / 0.55);
+    double strength = 0.7 + 0.6 * (sin(step * 12.9898) * 0.5 + 0.5);
+    std::normal_distribution<double> body(0, 0.04);
+    g[2] += 0.7 * strength * exp(-pow((phase - 0.08) / 0.03, 2)) + 0.25 * exp(-pow((phase - 0.3) / 0.05, 2)) - 0.15;
+    g[2] += body(noiseRandom);
+    g[0] += 0.1 * sin(t * 2 * M_PI / 1.1) + body(noiseRandom);
+  } else if (imuMotion == IMU_JUMP) {
+    // crouch and push off, weightless in the air, a hard landing
+    double phase = fmod(t, 1.6);
+    if (phase < 0.2) {
+      g[2] += 0.8 * sin(phase / 0.2 * M_PI);
+    } else if (phase < 0.55) {
+      g[0] *= 0.1;
+      g[1] *= 0.1;
+      g[2] = 0.05 + noise(noiseRandom);
+    } else {
+      g[2] += 2.5 * exp(-pow((phase - 0.6) / 0.025, 2));
+    }
+  }
+}
+
+// a sample through the pedometer (EMB_FUNC_EN_A PEDO_EN), counting into STEP_COUNTER_L/H
+static void imuPedometer(const double *g, unsigned odr) {
+  if (!(imuEmbRegs[0x17] & 0x80)) {
+    imuStepInterrupt = false;  // not latched, a pulse one sample long
+  }
+  if (!(imuEmbRegs[0x04] & 0x08)) {
+    return;
+  }
+  double magnitude = sqrt(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+  imuSinceStep++;
+  if (imuStepping) {
+    imuStepping = magnitude >= PEDO_FALL_G;
+  } else if (magnitude > PEDO_RISE_G && imuSinceStep >= PEDO_MIN_GAP_S * odr) {
+    imuStepping = true;
+    imuSinceStep = 0;
+    uint16_t steps = (imuEmbRegs[0x62] | (imuEmbRegs[0x63] << 8)) + 1;
+    imuEmbRegs[0x62] = steps & 0xFF;
+    imuEmbRegs[0x63] = steps >> 8;
+    imuEmbRegs[0x64] |= 0x20;  // EMB_FUNC_SRC: STEP_DETECTED
+    imuStepInterrupt = true;
+  }
+}
+
+// runs the samples due by now through the pedometer and into the FIFO (in continuous mode), the oldest is
+// overwritten once it's full
+static void imuCatchUp() {
+  unsigned odr = imuRate(imuRegs[0x10] >> 4);
+  if (odr == 0) {
+    return;
+  }
+  unsigned bdr = imuRate(imuRegs[0x09] & 0x0F);
+  bool batching = (imuRegs[0x0A] & 0x07) == 0x06 && bdr > 0;
+  unsigned every = batching ? max(odr / bdr, 1u) : 1;
+  unsigned long long due = (micros() - imuStartUs) * (unsigned long long) odr / 1000000;
+  static const float lsbPerG[4] = {16393, 2049, 8197, 4098};  // FS_XL 2, 16, 4, 8 g
+  float scale = lsbPerG[(imuRegs[0x10] >> 2) & 0x03];
+
+  for (; imuProduced < due; imuProduced++) {
+    double g[3];
+    imuMotionAt((double) imuProduced / odr, g);
+    imuPedometer(g, odr);
+    if (!batching || imuProduced % every != 0) {
+      continue;
+    }
+    ImuWord word;
+    for (int i = 0; i < 3; i++) {
+      word.xyz[i] = (int16_t) std::max(-32768.0, std::min(32767.0, g[i] * scale));
+    }
+    if (imuFifo.size() == LSM6DSO_FIFO_WORDS) {
+      imuFifo.erase(imuFifo.begin());
+      imuOverrun = true;
+    }
+    imuFifo.push_back(word);
+  }
+}
+
+static uint8_t imuRead() {
+  uint8_t reg = imuPointer;
+  uint8_t *bank = imuBank(reg);
+  uint8_t value = bank[reg & 0x7F];
+  if (bank == imuEmbRegs) {
+    // embedded function registers are plain storage here (the pedometer writes its count into them)
+  } else if (reg == 0x35) {
+    // EMB_FUNC_STATUS_MAINPAGE: IS_STEP_DET, reading it clears a latched step interrupt
+    value = imuStepInterrupt ? 0x08 : 0;
+    if (imuEmbRegs[0x17] & 0x80) {
+      imuStepInterrupt = false;
+    }
+  } else if (reg == 0x3A || reg == 0x3B) {
+    // FIFO_STATUS1/2: words waiting, watermark/overrun flags, reading STATUS2 clears the latched overrun
+    size_t words = imuFifo.size();
+    size_t watermark = imuRegs[0x07] | ((imuRegs[0x08] & 0x01) << 8);
+    if (reg == 0x3A) {
+      value = words & 0xFF;
+    } else {
+      value = ((words >> 8) & 0x03) | (imuOverrun ? 0x08 : 0) | (words == LSM6DSO_FIFO_WORDS ? 0x40 : 0) |
+              (watermark > 0 && words >= watermark ? 0x80 : 0);
+      imuOverrun = false;
+    }
+  } else if (reg >= 0x78 && reg <= 0x7E) {
+    // FIFO output: tag (accelerometer) then X/Y/Z, the word leaves the FIFO once its last byte is read
+    if (imuFifo.empty()) {
+      value = 0;
+    } else {
+      size_t index = reg - 0x78;
+      const ImuWord &word = imuFifo.front();
+      value = index == 0 ? 0x02 << 3 : (uint16_t) word.xyz[(index - 1) / 2] >> (index % 2 == 1 ? 0 : 8);
+      if (index == 6) {
+        imuFifo.erase(imuFifo.begin());
+      }
+    }
+    imuPointer = reg == 0x7E ? 0x78 : reg + 1;
+    return value;
+  }
+  if (imuRegs[0x12] & 0x04) {
+    imuPointer = (reg + 1) & 0x7F;
+  }
+  return value;
+}
+
+static void imuWrite(uint8_t reg, uint8_t value) {
+  uint8_t *bank = imuBank(reg);
+  if (bank == imuEmbRegs) {
+    if (reg == 0x64 && (value & 0x80)) {
+      // EMB_FUNC_SRC: PEDO_RST_STEP
+      imuEmbRegs[0x62] = 0;
+      imuEmbRegs[0x63] = 0;
+      value &= ~0x80;
+    }
+    imuEmbRegs[reg & 0x7F] = value;
+    return;
+  }
+  if (reg == 0x12 && (value & 0x01)) {
+    imuReset();
+    return;
+  }
+  if (reg == 0x0A || reg == 0x10) {
+    // bypass empties the FIFO, continuous starts filling it from now, and a new data rate starts over
+    imuFifo.clear();
+    imuOverrun = false;
+    imuStartUs = micros();
+    imuProduced = 0;
+  }
+  imuRegs[reg & 0x7F] = value;
+}
+
+// INT1 is high while the FIFO is at the watermark (INT1_FIFO_TH), or for a step when the embedded functions
+// are routed to it (MD1_CFG INT1_EMB_FUNC) and the step detector interrupt is on (EMB_FUNC_INT1)
+static bool imuInt1Level() {
+  size_t watermark = imuRegs[0x07] | ((imuRegs[0x08] & 0x01) << 8);
+  return ((imuRegs[0x0D] & 0x08) && watermark > 0 && imuFifo.size() >= watermark) ||
+         ((imuRegs[0x5E] & 0x02) && (imuEmbRegs[0x0A] & 0x08) && imuStepInterrupt);
+}
+
+// raises INT1 as soon as the samples due make it go high
+static void imuInterruptThread() {
+  while (true) {
+    bool high;
+    {
+      std::lock_guard<std::mutex> lock(imuMutex);
+      imuCatchUp();
+      high = imuInt1Level();
+    }
+    if (high && !imuInt1) {
+      fireEdge(LSM6DSO_INT1_PIN, true);
+    }
+    imuInt1 = high;
+    usleep(500);
+  }
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  this->address = address;
+  txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (txLen == sizeof(tx)) {
+    return 0;
+  }
+  tx[txLen++] = value;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  if (address == LSM6DSO_ADDRESS) {
+    static std::once_flag started;
+    std::call_once(started, []() {
+      imuReset();
+      std::thread(imuInterruptThread).detach();
+    });
+    std::lock_guard<std::mutex> lock(imuMutex);
+    imuCatchUp();
+    if (txLen >= 1) {
+      imuPointer = tx[0] & 0x7F;
+    }
+    for (size_t i = 1; i < txLen; i++) {
+      imuWrite(imuPointer, tx[i]);
+      if (imuRegs[0x12] & 0x04) {
+        imuPointer = (imuPointer + 1) & 0x7F;
+      }
+    }
+    return 0;
+  }
+  if (address != AHT20_ADDRESS) {
+    return 2;
+  }
+  // 0xAC starts a conversion, reset/calibrate commands don't change anything here
+  if (txLen >= 1 && tx[0] == 0xAC) {
+    aht20TriggeredMs = max(millis(), 1UL);
+  }
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop) {
+  rxPos = 0;
+  rxLen = 0;
+  if (address == LSM6DSO_ADDRESS) {
+    std::lock_guard<std::mutex> lock(imuMutex);
+    imuCatchUp();
+    rxLen = min((size_t) quantity, sizeof(rx));
+    for (size_t i = 0; i < rxLen; i++) {
+      rx[i] = imuRead();
+    }
+    // a read that drains the FIFO or clears the step interrupt drops INT1 straight away (the interrupt thread
+    // raises it again)
+    if (!imuInt1Level()) {
+      imuInt1 = false;
+    }
+    return rxLen;
+  }
+  if (address != AHT20_ADDRESS) {
+    return 0;
+  }
+  uint8_t answer[7];
+  aht20Answer(answer);
+  rxLen = min((size_t) quantity, sizeof(answer));
+  memcpy(rx, answer, rxLen);
+  return rxLen;
+}
+
+// ******** BLE ********
+
+void BLEDevice::init(const std::string &name) {
+  fprintf(stderr, "[hal] %llu BLE device %s\n", wallMillis(), name.c_str());
+}
+
+BLECharacteristic *BLEService::createCharacteristic(const char *uuid, uint32_t properties) {
+  BLECharacteristic *characteristic = new BLECharacteristic(uuid, properties);
+  if (properties & BLECharacteristic::PROPERTY_WRITE) {
+    bleCharacteristic = characteristic;
+  }
+  return characteristic;
+}
+
+void BLECharacteristic::notify() {
+  fprintf(stderr, "[hal] %llu BLE notify %s %s\n", wallMillis(), uuid.uuid.c_str(), value.c_str());
+}
+
+void BLECharacteristic::written(const std::string &value) {
+  fprintf(stderr, "[hal] %llu BLE write %s\n", wallMillis(), value.c_str());
+  this->value = value;
+  if (callbacks != NULL) {
+    callbacks->onWrite(this);
+  }
+}
+
+void BLEAdvertising::start() {
+  fprintf(stderr, "[hal] %llu BLE advertising\n", wallMillis());
+}
+
+// ******** FLASH ********
+
+static esp_partition_t spiffsPartition = {
+  ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x290000, 0x170000, "spiffs", false
+};
+
+static std::mutex flashMutex;
+static int flashFd = -1;
+
+// opens the flash file, filling it with 0xFF (erased) the first time
+static bool openFlash() {
+  if (flashFd >= 0) {
+    return true;
+  }
+  String path = envString("NATIVE_FLASH", "native_flash.bin");
+  flashFd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (flashFd < 0) {
+    return false;
+  }
+  off_t size = lseek(flashFd, 0, SEEK_END);
+  if (size < (off_t) spiffsPartition.size) {
+    std::vector<uint8_t> blank(spiffsPartition.size - size, 0xFF);
+    if (pwrite(flashFd, blank.data(), blank.size(), size) != (ssize_t) blank.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool flashRange(const esp_partition_t *partition, size_t offset, size_t size) {
+  return partition == &spiffsPartition && offset <= partition->size && size <= partition->size - offset;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+  std::lock_guard<std::mutex> lock(flashMutex);
+  if (type != ESP_PARTITION_TYPE_DATA ||
+      (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != spiffsPartition.subtype) ||
+      (label != NULL && strcmp(label, spiffsPartition.label) != 0) || !openFlash()) {
+    return NULL;
+  }
+  return &spiffsPartition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+  std::lock_guard<std::mutex> lock(flashMutex);
+  if (!flashRange(partition, src_offset, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  return pread(flashFd, dst, size, src_offset) == (ssize_t) size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+  std::lock_guard<std::mutex> lock(flashMutex);
+  if (!flashRange(partition, dst_offset, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  std::vector<uint8_t> bytes(size);
+  if (pread(flashFd, bytes.data(), size, dst_offset) != (ssize_t) size) {
+    return ESP_FAIL;
+  }
+  const uint8_t *data = (const uint8_t *) src;
+  for (size_t i = 0; i < size; i++) {
+    if ((data[i] & ~bytes[i]) != 0) {
+      fprintf(stderr, "[hal] flash write at 0x%zx sets bits that aren't erased\n", dst_offset + i);
+    }
+    bytes[i] &= data[i];
+  }
+  return pwrite(flashFd, bytes.data(), size, dst_offset) == (ssize_t) size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+  std::lock_guard<std::mutex> lock(flashMutex);
+  if (!flashRange(partition, offset, size)) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::vector<uint8_t> blank(size, 0xFF);
+  return pwrite(flashFd, blank.data(), size, offset) == (ssize_t) size ? ESP_OK : ESP_FAIL;
+}
+
+// ******** ENTRY POINT ********
+
+int main() {
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  std::thread(inputThread).detach();
+
+  setup();
+  while (true) {
+    loop();
+    // the real loopTask shares the core with other tasks, give the other processes a turn
+    usleep(100);
+  }
+}
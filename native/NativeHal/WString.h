@@ -0,0 +1,44 @@
+// NativeHal - just enough of the Arduino String class for the firmwares (wraps std::string)
+
+#ifndef NATIVE_HAL_WSTRING_H
+#define NATIVE_HAL_WSTRING_H
+
+#include <string>
+
+class String {
+public:
+  String(const char *s = "") : str(s ? s : "") {}
+  String(const std::string &s) : str(s) {}
+  explicit String(char c) : str(1, c) {}
+  explicit String(int value) : str(std::to_string(value)) {}
+  explicit String(unsigned int value) : str(std::to_string(value)) {}
+  explicit String(long value) : str(std::to_string(value)) {}
+  explicit String(unsigned long value) : str(std::to_string(value)) {}
+  explicit String(float value, unsigned int decimals = 2) : String((double) value, decimals) {}
+  explicit String(double value, unsigned int decimals = 2) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    str = buf;
+  }
+
+  const char *c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.length(); }
+
+  String &operator+=(const String &other) { str += other.str; return *this; }
+  String &operator+=(const char *other) { str += other; return *this; }
+  String &operator+=(char c) { str += c; return *this; }
+
+  bool operator==(const String &other) const { return str == other.str; }
+  bool operator!=(const String &other) const { return str != other.str; }
+  bool operator==(const char *other) const { return str == other; }
+  bool operator!=(const char *other) const { return str != other; }
+
+  friend String operator+(const String &a, const String &b) { return String(a.str + b.str); }
+  friend String operator+(const String &a, const char *b) { return String(a.str + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.str); }
+
+private:
+  std::string str;
+};
+
+#endif
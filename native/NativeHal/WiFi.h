@@ -0,0 +1,68 @@
+// NativeHal - WiFi station and WiFiClient. The station is connected NATIVE_WIFI_JOIN_MS after begin() is called
+// (at once by default), except while "wifi off" from stdin is in effect; WiFiClient is a plain TCP socket.
+// Set NATIVE_SERVER=host:port to send every connection to a local stand-in (e.g. the Flask server on
+// 127.0.0.1:8080) instead of the address hardcoded in the firmware
+
+#ifndef NATIVE_HAL_WIFI_H
+#define NATIVE_HAL_WIFI_H
+
+#include "Arduino.h"
+#include "Client.h"
+#include "IPAddress.h"
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA,
+  WIFI_AP,
+  WIFI_AP_STA
+} wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode) { return true; }
+  wl_status_t begin(const char *ssid, const char *pass = NULL);
+  wl_status_t status();
+  bool disconnect(bool wifiOff = false);
+  bool setSleep(bool enabled) { return true; }
+
+  // channel comes from NATIVE_CHANNEL (default 6), same for the AP and for scans
+  int32_t channel();
+  int16_t scanNetworks();
+  String SSID(uint8_t i);
+  int32_t channel(uint8_t i);
+
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  String macAddress();
+
+private:
+  wl_status_t connectedStatus = WL_DISCONNECTED;
+  unsigned long connectedAt = 0;  // millis() the association and DHCP are done
+  String ssid;
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client {
+public:
+  ~WiFiClient() { stop(); }
+
+  int connect(IPAddress ip, uint16_t port) override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size) override;
+  uint8_t connected() override;
+  void stop() override;
+
+private:
+  int fd = -1;
+};
+
+#endif
@@ -0,0 +1,38 @@
+// NativeHal - I2C bus with simulated devices instead of real ones:
+//   AHT20 temperature/humidity sensor (0x38): a conversion takes 80 ms (status busy until then) and the readings
+//   drift slowly, 22 +/- 3 C and 45 +/- 10 % rH over ~10 minutes
+//   LSM6DSO accelerometer (0x6B): samples into its FIFO at the configured rate, INT1 on GPIO 34, and feels
+//   whatever the "imu" stdin command last said (see NativeHal.cpp)
+// Any other address NACKs
+
+#ifndef NATIVE_HAL_WIRE_H
+#define NATIVE_HAL_WIRE_H
+
+#include "Arduino.h"
+
+#define I2C_BUFFER_LENGTH 128
+
+class TwoWire {
+public:
+  bool begin() { return true; }
+  void setClock(uint32_t frequency) {}
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t value);
+  uint8_t endTransmission(bool sendStop = true);  // 0 = ACKed, 2 = address NACKed
+  uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+  int available() { return rxLen - rxPos; }
+  int read() { return rxPos < rxLen ? rx[rxPos++] : -1; }
+
+private:
+  uint8_t address = 0;
+  uint8_t tx[I2C_BUFFER_LENGTH];
+  size_t txLen = 0;
+  uint8_t rx[I2C_BUFFER_LENGTH];
+  size_t rxPos = 0;
+  size_t rxLen = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
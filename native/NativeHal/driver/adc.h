@@ -0,0 +1,37 @@
+// NativeHal - ADC1 channel setup used by the I2S/DMA sampling path (attenuation/width are no-ops on Linux)
+
+#ifndef NATIVE_HAL_ADC_H
+#define NATIVE_HAL_ADC_H
+
+#include "../Arduino.h"
+
+typedef enum {
+  ADC_UNIT_1 = 1,
+  ADC_UNIT_2 = 2
+} adc_unit_t;
+
+// ADC1 channel n is wired to GPIO 36, 37, 38, 39, 32, 33, 34, 35 (in that order)
+typedef enum {
+  ADC1_CHANNEL_0 = 0, ADC1_CHANNEL_1, ADC1_CHANNEL_2, ADC1_CHANNEL_3,
+  ADC1_CHANNEL_4, ADC1_CHANNEL_5, ADC1_CHANNEL_6, ADC1_CHANNEL_7,
+  ADC1_CHANNEL_MAX
+} adc1_channel_t;
+
+typedef enum {
+  ADC_ATTEN_DB_0 = 0,
+  ADC_ATTEN_DB_2_5,
+  ADC_ATTEN_DB_6,
+  ADC_ATTEN_DB_11
+} adc_atten_t;
+
+typedef enum {
+  ADC_WIDTH_BIT_9 = 0,
+  ADC_WIDTH_BIT_10,
+  ADC_WIDTH_BIT_11,
+  ADC_WIDTH_BIT_12
+} adc_bits_width_t;
+
+inline esp_err_t adc1_config_width(adc_bits_width_t width) { return ESP_OK; }
+inline esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten) { return ESP_OK; }
+
+#endif
@@ -0,0 +1,23 @@
+// NativeHal - GPIO wake-up levels for light sleep (see esp_sleep.h)
+
+#ifndef NATIVE_HAL_GPIO_H
+#define NATIVE_HAL_GPIO_H
+
+#include "../Arduino.h"
+
+#define ESP_ERR_INVALID_ARG 0x102
+
+typedef enum {
+  GPIO_INTR_DISABLE = 0,
+  GPIO_INTR_POSEDGE,
+  GPIO_INTR_NEGEDGE,
+  GPIO_INTR_ANYEDGE,
+  GPIO_INTR_LOW_LEVEL,
+  GPIO_INTR_HIGH_LEVEL
+} gpio_int_type_t;
+
+// only the level types wake the chip from light sleep
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num);
+
+#endif
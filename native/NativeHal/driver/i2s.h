@@ -0,0 +1,61 @@
+// NativeHal - I2S in built-in ADC mode, which is how the ESP32 streams ADC1 samples into memory with DMA.
+// i2s_read hands out samples of the selected channel's pin (set with "analog", plus NATIVE_ADC_NOISE) paced
+// at the configured sample rate, each tagged with the channel in the top 4 bits like the hardware does
+
+#ifndef NATIVE_HAL_I2S_H
+#define NATIVE_HAL_I2S_H
+
+#include "../Arduino.h"
+#include "../freertos/FreeRTOS.h"
+#include "adc.h"
+
+typedef enum {
+  I2S_NUM_0 = 0,
+  I2S_NUM_1,
+  I2S_NUM_MAX
+} i2s_port_t;
+
+typedef enum {
+  I2S_MODE_MASTER = 1,
+  I2S_MODE_SLAVE = 2,
+  I2S_MODE_TX = 4,
+  I2S_MODE_RX = 8,
+  I2S_MODE_DAC_BUILT_IN = 16,
+  I2S_MODE_ADC_BUILT_IN = 32
+} i2s_mode_t;
+
+typedef enum {
+  I2S_BITS_PER_SAMPLE_16BIT = 16,
+  I2S_BITS_PER_SAMPLE_32BIT = 32
+} i2s_bits_per_sample_t;
+
+typedef enum {
+  I2S_CHANNEL_FMT_RIGHT_LEFT = 0,
+  I2S_CHANNEL_FMT_ALL_RIGHT,
+  I2S_CHANNEL_FMT_ALL_LEFT,
+  I2S_CHANNEL_FMT_ONLY_RIGHT,
+  I2S_CHANNEL_FMT_ONLY_LEFT
+} i2s_channel_fmt_t;
+
+typedef enum {
+  I2S_COMM_FORMAT_STAND_I2S = 0x01
+} i2s_comm_format_t;
+
+typedef struct {
+  int mode;
+  uint32_t sample_rate;
+  i2s_bits_per_sample_t bits_per_sample;
+  i2s_channel_fmt_t channel_format;
+  i2s_comm_format_t communication_format;
+  int intr_alloc_flags;
+  int dma_buf_count;
+  int dma_buf_len;
+  bool use_apll;
+} i2s_config_t;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *config, int queueSize, void *queue);
+esp_err_t i2s_set_adc_mode(adc_unit_t unit, adc1_channel_t channel);
+esp_err_t i2s_adc_enable(i2s_port_t port);
+esp_err_t i2s_read(i2s_port_t port, void *dest, size_t size, size_t *bytesRead, TickType_t ticks);
+
+#endif
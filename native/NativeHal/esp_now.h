@@ -0,0 +1,38 @@
+// NativeHal - ESP-NOW over UDP on localhost. Every process gets a UDP port from its MAC (NATIVE_MAC, e.g.
+// NATIVE_MAC=ec:e3:34:79:8b:74 for the devkitV1) so frames sent to a peer's MAC reach that process.
+// Received frames are acked like the real radio does, and callbacks run on a separate thread like the
+// WiFi task. NATIVE_ESPNOW_LOSS=0.1 drops 10% of frames to simulate a bad link
+
+#ifndef NATIVE_HAL_ESP_NOW_H
+#define NATIVE_HAL_ESP_NOW_H
+
+#include "Arduino.h"
+
+#define ESP_NOW_ETH_ALEN     6
+#define ESP_NOW_MAX_DATA_LEN 250
+
+#define ESP_ERR_ESPNOW_NOT_INIT -2
+#define ESP_ERR_ESPNOW_ARG      -3
+
+typedef enum {
+  ESP_NOW_SEND_SUCCESS = 0,
+  ESP_NOW_SEND_FAIL
+} esp_now_send_status_t;
+
+typedef struct esp_now_peer_info {
+  uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+  uint8_t channel;
+  bool encrypt;
+} esp_now_peer_info_t;
+
+typedef void (*esp_now_recv_cb_t)(const uint8_t *mac, const uint8_t *data, int len);
+typedef void (*esp_now_send_cb_t)(const uint8_t *mac, esp_now_send_status_t status);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_deinit();
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,41 @@
+// NativeHal - raw flash partitions backed by a file (NATIVE_FLASH, default native_flash.bin, created blank on
+// first use). Behaves like NOR flash: erased bytes read 0xFF, a write can only clear bits (writing over bits
+// that aren't erased is reported on stderr, the result is the AND like on the chip) and erases are 4 KB sectors.
+// Only the one data partition Lab 3 uses is there: "spiffs", the size it has in the default partition table
+
+#ifndef NATIVE_HAL_ESP_PARTITION_H
+#define NATIVE_HAL_ESP_PARTITION_H
+
+#include "Arduino.h"
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+#define ESP_ERR_INVALID_ARG  0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+  ESP_PARTITION_SUBTYPE_ANY = 0xff
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+  bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+#endif
@@ -0,0 +1,23 @@
+// NativeHal - light sleep. esp_light_sleep_start() blocks until an enabled wake-up source fires: the timer, or a
+// pin set up with gpio_wakeup_enable() reaching its level (the simulated LSM6DSO's INT1 on GPIO 34, or a button)
+
+#ifndef NATIVE_HAL_ESP_SLEEP_H
+#define NATIVE_HAL_ESP_SLEEP_H
+
+#include "Arduino.h"
+#include "driver/gpio.h"
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_TIMER = 4,
+  ESP_SLEEP_WAKEUP_GPIO = 7
+} esp_sleep_source_t;
+
+typedef esp_sleep_source_t esp_sleep_wakeup_cause_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_sleep_enable_gpio_wakeup();
+esp_err_t esp_light_sleep_start();
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+
+#endif
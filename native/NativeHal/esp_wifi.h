@@ -0,0 +1,17 @@
+// NativeHal - the couple of esp_wifi calls used to pin the ESP-NOW channel (no-ops on Linux)
+
+#ifndef NATIVE_HAL_ESP_WIFI_H
+#define NATIVE_HAL_ESP_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum {
+  WIFI_SECOND_CHAN_NONE = 0,
+  WIFI_SECOND_CHAN_ABOVE,
+  WIFI_SECOND_CHAN_BELOW
+} wifi_second_chan_t;
+
+inline esp_err_t esp_wifi_set_promiscuous(bool enabled) { return ESP_OK; }
+inline esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second) { return ESP_OK; }
+
+#endif
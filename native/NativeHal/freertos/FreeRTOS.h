@@ -0,0 +1,19 @@
+// NativeHal - the FreeRTOS types/macros the firmwares use, with a 1 ms tick like the Arduino core
+
+#ifndef NATIVE_HAL_FREERTOS_H
+#define NATIVE_HAL_FREERTOS_H
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdPASS  pdTRUE
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+#define portYIELD_FROM_ISR(...)
+
+#endif
@@ -0,0 +1,16 @@
+// NativeHal - binary semaphores (mutex + condition variable), enough to let loop() sleep until an ISR or
+// timer callback has something for it
+
+#ifndef NATIVE_HAL_SEMPHR_H
+#define NATIVE_HAL_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+typedef struct native_semaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *higherPriorityTaskWoken);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+
+#endif
@@ -0,0 +1,15 @@
+// NativeHal - FreeRTOS tasks run as detached threads (priority and core are ignored)
+
+#ifndef NATIVE_HAL_TASK_H
+#define NATIVE_HAL_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+typedef struct native_task *TaskHandle_t;
+typedef unsigned UBaseType_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+
+#endif
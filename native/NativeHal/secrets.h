@@ -0,0 +1,9 @@
+// NativeHal - placeholder WiFi credentials so the firmwares build natively without the real secrets.h
+
+#ifndef NATIVE_HAL_SECRETS_H
+#define NATIVE_HAL_SECRETS_H
+
+#define WIFI_SSID "native"
+#define WIFI_PASS "native"
+
+#endif
@@ -0,0 +1,191 @@
+# fleet_load - load test for the devkitV1 gateway built with the native env. Starts the gateway, a stand-in for
+# the cloud server that counts what reaches it, and N simulated TTGOs that each send vehicle frames over the
+# NativeHal ESP-NOW-over-UDP transport. Prints how many frames/s were offered and acked, how many lines and
+# bytes per second reached the "cloud", and percentiles of each frame's latency from the simulated TTGO sending
+# it to the cloud reading the batch it's in (every raw or event line carries the sender's time stamp, which is
+# the same host clock)
+#
+#   python3 native/fleet_load.py "Final Project/Code/DevkitV1/.pio/build/native/program" --senders 8 16 32 --rate 20
+#
+# Every simulated vehicle swings between 40 and 80 mph (so it crosses the 70 mph limit twice per cycle) and
+# toggles a dash light every 30 s. With raw forwarding the ceiling is where lines/s stops following offered/s.
+# To compare uplink volume against edge aggregation, run the same load against a gateway built with
+# -DEDGE_AGGREGATION=0 and one without, for longer than the 30 s summary interval
+
+import argparse
+import os
+import socket
+import struct
+import subprocess
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+GATEWAY_MAC = bytes.fromhex("ece334798b74")
+VEHICLE_FRAME_VERSION = 1
+
+
+# same as portForMac() in NativeHal.cpp
+def port_for_mac(mac):
+    return 40000 + (((mac[4] << 8) | mac[5]) % 20000)
+
+
+# CRC-16/CCITT-FALSE like frameCrc() in lib/VehicleFrame
+def frame_crc(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+# packed vehicle_frame: version, lights, speed, sequence, timestamp, crc
+def vehicle_frame(lights, speed, sequence, timestamp):
+    body = struct.pack("<BBBHI", VEHICLE_FRAME_VERSION, lights, speed, sequence & 0xFFFF, timestamp & 0xFFFFFFFF)
+    return body + struct.pack("<H", frame_crc(body))
+
+
+# the simulated TTGOs' millis(), a 32 bit ms count like vehicle_frame.timestamp
+def now_ms():
+    return int(time.monotonic() * 1000) & 0xFFFFFFFF
+
+
+# sender ms of a raw ("<vehicle>,<sender ms>,...") or event ("E,<vehicle>,<sender ms>,...") line, None for
+# summaries and anything else
+def sender_ms(line):
+    fields = line.split(b",")
+    if fields[0] == b"E":
+        fields = fields[1:]
+    elif fields[0] == b"S":
+        return None
+    try:
+        return int(fields[1])
+    except (IndexError, ValueError):
+        return None
+
+
+# nearest rank percentile of a sorted list
+def percentile(values, p):
+    return values[min(len(values) - 1, max(0, int(round(p / 100.0 * len(values))) - 1))]
+
+
+class Cloud(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    lines = 0
+    events = 0
+    summaries = 0
+    requests = 0
+    bytes = 0  # request line + headers + body, what the gateway's radio has to send
+    latencies = []  # ms from a frame being sent to its line arriving here
+    lock = threading.Lock()
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        arrived = now_ms()
+        with Cloud.lock:
+            Cloud.lines += body.count(b"\n")
+            Cloud.events += body.count(b"E,")
+            Cloud.summaries += body.count(b"S,")
+            Cloud.requests += 1
+            Cloud.bytes += len(self.requestline) + 2 + len(str(self.headers)) + len(body)
+            for line in body.splitlines():
+                sent = sender_ms(line)
+                if sent is not None:
+                    Cloud.latencies.append((arrived - sent) & 0xFFFFFFFF)
+        self.send_response(200)
+        self.send_header("Content-Length", "2")
+        self.end_headers()
+        self.wfile.write(b"ok")
+
+    def log_message(self, *args):
+        pass
+
+
+# triangle wave between 40 and 80 mph with a 20 s period, every vehicle starting at a different point
+def speed_at(index, t):
+    phase = (t / 20.0 + index / 7.0) % 1.0
+    return int(40 + 80 * (phase if phase < 0.5 else 1.0 - phase))
+
+
+def run_sender(index, rate, stop, counts):
+    mac = bytes([0x02, 0x00, 0x00, 0x00, 0x10 + (index >> 8), index & 0xFF])
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", port_for_mac(mac)))
+    sock.settimeout(0.001)
+    gateway = ("127.0.0.1", port_for_mac(GATEWAY_MAC))
+
+    sequence = 0
+    start = time.monotonic()
+    next_send = start
+    while not stop.is_set():
+        now = time.monotonic()
+        if now >= next_send:
+            sequence += 1
+            # a TTGO only sends this often while the speed keeps changing, which it does here
+            lights = int((now - start + index) / 30) & 0x7
+            frame = vehicle_frame(lights, speed_at(index, now - start), sequence, now_ms())
+            sock.sendto(b"D" + mac + frame, gateway)
+            counts[index][0] += 1
+            next_send += 1.0 / rate
+        try:
+            packet = sock.recv(64)
+            if packet[:1] == b"A":
+                counts[index][1] += 1
+        except socket.timeout:
+            pass
+    sock.close()
+
+
+def run(gateway, senders, rate, seconds):
+    Cloud.lines = Cloud.events = Cloud.summaries = Cloud.requests = Cloud.bytes = 0
+    Cloud.latencies = []
+    cloud = ThreadingHTTPServer(("127.0.0.1", 0), Cloud)
+    threading.Thread(target=cloud.serve_forever, daemon=True).start()
+
+    env = dict(os.environ, NATIVE_MAC=GATEWAY_MAC.hex(":"), NATIVE_SERVER=f"127.0.0.1:{cloud.server_port}")
+    process = subprocess.Popen([gateway], env=env, stdin=subprocess.PIPE, stdout=subprocess.DEVNULL,
+                               stderr=subprocess.DEVNULL)
+    time.sleep(0.5)
+
+    stop = threading.Event()
+    counts = [[0, 0] for _ in range(senders)]
+    threads = [threading.Thread(target=run_sender, args=(i, rate, stop, counts)) for i in range(senders)]
+    for thread in threads:
+        thread.start()
+    time.sleep(seconds)
+    stop.set()
+    for thread in threads:
+        thread.join()
+
+    # let the last full batches go up (anything under the flush size waits for the 30 s age limit)
+    time.sleep(1)
+    process.stdin.close()
+    process.kill()
+    cloud.shutdown()
+
+    sent = sum(c[0] for c in counts)
+    acked = sum(c[1] for c in counts)
+    print(f"{senders:4d} senders x {rate:g} Hz: offered {sent / seconds:8.1f}/s  acked {acked / seconds:8.1f}/s  "
+          f"lines {Cloud.lines / seconds:8.1f}/s ({Cloud.events} events, {Cloud.summaries} summaries)  "
+          f"uplink {Cloud.requests / seconds:6.2f} req/s {Cloud.bytes / seconds:9.1f} B/s")
+    latencies = sorted(Cloud.latencies)
+    if latencies:
+        print(f"     frame to cloud: {len(latencies) / seconds:8.1f} frames/s, latency ms p50 "
+              f"{percentile(latencies, 50)}  p90 {percentile(latencies, 90)}  p99 {percentile(latencies, 99)}  "
+              f"max {latencies[-1]}")
+    else:
+        print("     frame to cloud: no frames reached it")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="load test the native devkitV1 gateway with simulated TTGOs")
+    parser.add_argument("gateway", help="path to the native DevkitV1 program")
+    parser.add_argument("--senders", type=int, nargs="+", default=[1, 8, 16, 32])
+    parser.add_argument("--rate", type=float, default=10, help="frames per second per sender")
+    parser.add_argument("--seconds", type=float, default=5)
+    args = parser.parse_args()
+
+    for n in args.senders:
+        run(args.gateway, n, args.rate, args.seconds)
@@ -0,0 +1,141 @@
+# gateway_latency - per-sample latency of the devkitV1 gateway, from a TTGO sending a frame to the cloud getting
+# it, for the gateway as it is and as it was before it kept the AP and ESP-NOW up together (the old one stopped
+# ESP-NOW, rejoined the AP and opened a new HTTP connection for every frame, so it was deaf to frames meanwhile).
+# One simulated TTGO sends a frame every --interval s over the NativeHal ESP-NOW-over-UDP transport, and the
+# stand-in cloud takes both the old GET /?...&speed=N requests and the batch POSTs. Prints each frame's latency,
+# the percentiles and how many frames never got there
+#
+#   git show f889b28:"Final Project/Code/DevkitV1/main.cpp" > gateway_before.cpp
+#   g++ -std=gnu++17 -pthread -Inative/NativeHal gateway_before.cpp native/NativeHal/NativeHal.cpp -o gateway_before
+#   python3 native/gateway_latency.py ./gateway_before --legacy
+#   python3 native/gateway_latency.py "Final Project/Code/DevkitV1/.pio/build/native/program"
+#
+# --join-ms sets NATIVE_WIFI_JOIN_MS, how long the stand-in AP takes to associate and hand out an address
+# (1500 ms by default, a real AP with DHCP takes 1-3 s). Every frame toggles a dash light, so the new gateway
+# sends it right away as an event instead of waiting for a batch to fill (the old one sent every frame on its
+# own anyway). --legacy sends the old 16 byte receive_struct instead of vehicle_frame
+
+import argparse
+import os
+import socket
+import struct
+import subprocess
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+from fleet_load import GATEWAY_MAC, now_ms, percentile, port_for_mac, sender_ms, vehicle_frame
+
+SENDER_MAC = bytes.fromhex("020000001001")
+
+
+class Cloud(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    arrivals = {}  # frame key (speed for the old gateway, sender ms for the new one) -> ms it got here
+    lock = threading.Lock()
+
+    def arrived(self, key, at):
+        with Cloud.lock:
+            Cloud.arrivals.setdefault(key, at)
+
+    def answer(self, close):
+        self.send_response(200)
+        self.send_header("Content-Length", "2")
+        if close:
+            self.send_header("Connection", "close")
+            self.close_connection = True
+        self.end_headers()
+        self.wfile.write(b"ok")
+
+    # the old gateway: one GET per frame, the speed tells which
+    def do_GET(self):
+        at = now_ms()
+        speed = parse_qs(urlparse(self.path).query).get("speed")
+        if speed:
+            self.arrived(int(speed[0]), at)
+        self.answer(True)
+
+    # the new gateway: batches, raw and event lines carry the frame's sender ms
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        at = now_ms()
+        for line in body.splitlines():
+            sent = sender_ms(line)
+            if sent is not None:
+                self.arrived(sent, at)
+        self.answer(False)
+
+    def log_message(self, *args):
+        pass
+
+
+# one TTGO, returns {key: ms sent} for every frame it sent
+def send_frames(frames, interval, legacy):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", port_for_mac(SENDER_MAC)))
+    gateway = ("127.0.0.1", port_for_mac(GATEWAY_MAC))
+
+    sent = {}
+    next_send = time.monotonic()
+    for i in range(frames):
+        time.sleep(max(0.0, next_send - time.monotonic()))
+        at = now_ms()
+        lights = (i + 1) & 1  # a new vehicle starts with every light off
+        if legacy:
+            # receive_struct: engine, tire, oil light and speed as ints, the speed picks the frame out again
+            key = i % 100
+            frame = struct.pack("<iiii", lights, 0, 0, key)
+        else:
+            key = at
+            frame = vehicle_frame(lights, 50, i + 1, at)
+        sent[key] = at
+        sock.sendto(b"D" + SENDER_MAC + frame, gateway)
+        next_send += interval
+    sock.close()
+    return sent
+
+
+def run(gateway, frames, interval, join_ms, legacy):
+    Cloud.arrivals = {}
+    cloud = ThreadingHTTPServer(("127.0.0.1", 0), Cloud)
+    threading.Thread(target=cloud.serve_forever, daemon=True).start()
+
+    env = dict(os.environ, NATIVE_MAC=GATEWAY_MAC.hex(":"), NATIVE_SERVER=f"127.0.0.1:{cloud.server_port}",
+               NATIVE_WIFI_JOIN_MS=str(join_ms))
+    process = subprocess.Popen([gateway], env=env, stdin=subprocess.PIPE, stdout=subprocess.DEVNULL,
+                               stderr=subprocess.DEVNULL)
+    # the new gateway joins the AP in setup()
+    time.sleep(join_ms / 1000.0 + 0.5)
+
+    sent = send_frames(frames, interval, legacy)
+    # the last frame gets as long as the old gateway's whole cycle could take
+    time.sleep(join_ms / 1000.0 + 3)
+    process.stdin.close()
+    process.kill()
+    cloud.shutdown()
+
+    latencies = []
+    for key, at in sent.items():
+        if key in Cloud.arrivals:
+            latencies.append((Cloud.arrivals[key] - at) & 0xFFFFFFFF)
+    print(f"{'old' if legacy else 'new'} gateway, a frame every {interval:g} s, AP join {join_ms} ms: "
+          f"{len(latencies)} of {len(sent)} frames reached the cloud ({len(sent) - len(latencies)} lost)")
+    print("  per frame (ms): " + " ".join(str(latency) for latency in latencies))
+    latencies.sort()
+    if latencies:
+        print(f"  latency ms p50 {percentile(latencies, 50)}  p90 {percentile(latencies, 90)}  "
+              f"max {latencies[-1]}")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="per-sample latency of the native devkitV1 gateway")
+    parser.add_argument("gateway", help="path to the native DevkitV1 program")
+    parser.add_argument("--legacy", action="store_true", help="the gateway from before, sent receive_structs")
+    parser.add_argument("--frames", type=int, default=20)
+    parser.add_argument("--interval", type=float, nargs="+", default=[5, 1], help="seconds between frames")
+    parser.add_argument("--join-ms", type=int, default=1500)
+    args = parser.parse_args()
+
+    for interval in args.interval:
+        run(args.gateway, args.frames, interval, args.join_ms, args.legacy)
@@ -0,0 +1,134 @@
+// link_test - checks LinkReceiver's sequence handling on the host: duplicates, late frames, losses and a TTGO
+// rebooting (sequence and millis() both starting over) at any point of its count. Prints every case and exits
+// non-zero if one of them fails
+//
+//   g++ -std=gnu++17 -pthread -Inative/NativeHal -Ilib/ReliableLink native/link_test.cpp
+//       lib/ReliableLink/ReliableLink.cpp native/NativeHal/NativeHal.cpp -o link_test
+//   ./link_test < /dev/null
+
+#include <ReliableLink.h>
+
+static int failures = 0;
+
+static const char *resultName(LinkResult result) {
+  switch (result) {
+    case LINK_NEW: return "NEW";
+    case LINK_DUPLICATE: return "DUPLICATE";
+    case LINK_OUT_OF_ORDER: return "OUT_OF_ORDER";
+  }
+  return "?";
+}
+
+// one frame through the receiver, with the result it has to give
+static void expect(LinkReceiver &link, uint16_t sequence, uint32_t senderMs, LinkResult expected) {
+  LinkResult result = link.accept(sequence, senderMs);
+  if (result != expected) {
+    printf("    FAIL: #%u sent at %lu ms is %s, should be %s\n", sequence, (unsigned long) senderMs,
+           resultName(result), resultName(expected));
+    failures++;
+  }
+}
+
+static void expectStats(const LinkReceiver &link, unsigned long received, unsigned long duplicates,
+                        unsigned long outOfOrder, unsigned long lost, unsigned long restarts) {
+  const LinkReceiverStats &stats = link.stats();
+  if (stats.received != received || stats.duplicates != duplicates || stats.outOfOrder != outOfOrder ||
+      stats.lost != lost || stats.restarts != restarts) {
+    printf("    FAIL: counted %lu/%lu/%lu/%lu/%lu, should be %lu/%lu/%lu/%lu/%lu "
+           "(received/duplicates/out of order/lost/restarts)\n",
+           stats.received, stats.duplicates, stats.outOfOrder, stats.lost, stats.restarts,
+           received, duplicates, outOfOrder, lost, restarts);
+    failures++;
+  }
+}
+
+// a TTGO that's been up for a while: frames 1..count, one every stepMs from startMs
+static void run(LinkReceiver &link, uint16_t from, uint16_t count, uint32_t startMs, uint32_t stepMs) {
+  for (uint16_t i = 0; i < count; i++) {
+    expect(link, from + i, startMs + i * stepMs, LINK_NEW);
+  }
+}
+
+static void inOrderAndRetransmits() {
+  printf("  in order, a retransmission and a late frame\n");
+  LinkReceiver link;
+  run(link, 1, 5, 1000, 100);
+  expect(link, 5, 1400, LINK_DUPLICATE);        // its ack got lost, the TTGO sent it again
+  expect(link, 7, 1600, LINK_NEW);              // #6 went missing
+  expect(link, 6, 1500, LINK_OUT_OF_ORDER);     // and turned up after #7
+  expect(link, 6, 1500, LINK_DUPLICATE);
+  expectStats(link, 6, 2, 1, 0, 0);
+}
+
+static void rebootAtLowSequence() {
+  printf("  reboot at a low sequence number (heartbeat rate, the new count starts under the old one)\n");
+  LinkReceiver link;
+  run(link, 1, 10, 5000, 5000);                 // #10 at 50 s
+  expect(link, 1, 900, LINK_NEW);               // rebooted, first frame 0.9 s after boot
+  expect(link, 2, 1500, LINK_NEW);              // a light toggle right after
+  expect(link, 2, 1500, LINK_DUPLICATE);
+  run(link, 3, 10, 6500, 5000);
+  expectStats(link, 22, 1, 0, 0, 1);
+}
+
+static void rebootOntoSameSequence() {
+  printf("  reboot that lands on the sequence number last seen\n");
+  LinkReceiver link;
+  run(link, 1, 3, 20000, 5000);                 // #3 at 30 s
+  expect(link, 1, 800, LINK_NEW);
+  expect(link, 2, 1000, LINK_NEW);
+  expect(link, 3, 1200, LINK_NEW);              // not a duplicate of the old #3
+  expectStats(link, 6, 0, 0, 0, 1);
+}
+
+static void rebootAfterShortUptime() {
+  printf("  reboot before the old count got far, new frames overtake its sequence number\n");
+  LinkReceiver link;
+  run(link, 1, 2, 1000, 5000);                  // #2 at 6 s, the heartbeat after the first frame
+  expect(link, 1, 700, LINK_NEW);
+  run(link, 2, 5, 900, 100);                    // none of these count as losses
+  expectStats(link, 8, 0, 0, 0, 1);
+}
+
+static void rebootAfterLongUptime() {
+  printf("  reboot far behind the last sequence number\n");
+  LinkReceiver link;
+  run(link, 1000, 5, 900000, 5000);
+  expect(link, 1, 600, LINK_NEW);
+  expectStats(link, 6, 0, 0, 0, 1);
+}
+
+static void wraparounds() {
+  printf("  sequence and millis() wrapping around\n");
+  LinkReceiver link;
+  run(link, 65534, 4, 0xFFFFFF00, 0x80);        // 65534, 65535, 0, 1 and the clock wraps between the 2nd and 3rd
+  expect(link, 0, 0x00000000, LINK_DUPLICATE);
+  expect(link, 65535, 0xFFFFFF80, LINK_DUPLICATE);
+  expectStats(link, 4, 2, 0, 0, 0);
+}
+
+static void staleFrames() {
+  printf("  an old frame from long before the newest one is a reboot, not a late frame\n");
+  LinkReceiver link;
+  run(link, 1, 10, 1000, 100);                  // #10 at 1.9 s
+  expect(link, 8, 1700, LINK_DUPLICATE);        // a real retransmission, 200 ms behind
+  expect(link, 5, 1900 - LINK_MAX_LATE_MS - 1, LINK_NEW);
+  expectStats(link, 11, 1, 0, 0, 1);
+}
+
+void setup() {
+  printf("LinkReceiver\n");
+  inOrderAndRetransmits();
+  rebootAtLowSequence();
+  rebootOntoSameSequence();
+  rebootAfterShortUptime();
+  rebootAfterLongUptime();
+  wraparounds();
+  staleFrames();
+
+  printf(failures == 0 ? "PASS\n" : "FAIL: %d checks\n", failures);
+  exit(failures == 0 ? 0 : 1);
+}
+
+void loop() {
+}
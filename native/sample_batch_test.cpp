@@ -0,0 +1,92 @@
+// sample_batch_test - checks on the host that SampleBatch only removes what was sent once the server has it,
+// the way the devkitV1 uses it: peek() the buffer, keep pushing while the POST is out, then consume(). Covers
+// the buffer overflowing while a full batch is in flight. Exits non-zero if a case fails
+//
+//   g++ -std=gnu++17 -pthread -Inative/NativeHal -Ilib/SampleBatch native/sample_batch_test.cpp
+//       lib/SampleBatch/SampleBatch.cpp native/NativeHal/NativeHal.cpp -o sample_batch_test
+//   ./sample_batch_test < /dev/null
+
+#include <SampleBatch.h>
+
+static const FlushPolicy policy = { 16, 30 * 1000, true };
+
+static int failures = 0;
+
+// samples are told apart by senderMs, the n-th one pushed has senderMs n
+static void pushSamples(SampleBatch &batch, uint32_t &next, unsigned n) {
+  for (unsigned i = 0; i < n; i++) {
+    Sample sample;
+    sample.senderMs = next++;
+    batch.push(sample, false);
+  }
+}
+
+// the buffer has to hold exactly the samples first..first + size - 1, oldest first
+static void expect(const char *name, SampleBatch &batch, uint32_t first, uint8_t size) {
+  Sample buffered[SAMPLE_BATCH_CAPACITY];
+  uint8_t n = batch.peek(buffered, SAMPLE_BATCH_CAPACITY);
+  bool ok = n == size;
+  for (uint8_t i = 0; ok && i < n; i++) {
+    ok = buffered[i].senderMs == first + i;
+  }
+  printf("  %s: %u buffered, %lu overwritten\n", name, n, batch.overwritten());
+  if (!ok) {
+    printf("    FAIL: should hold #%lu-#%lu, holds %u from #%lu\n", (unsigned long) first,
+           (unsigned long) (first + size - 1), n, n > 0 ? (unsigned long) buffered[0].senderMs : 0UL);
+    failures++;
+  }
+}
+
+// sends count samples, pushes arriving ones while the POST is out, then the server takes it
+static void sendWhilePushing(SampleBatch &batch, uint32_t &next, uint8_t count, unsigned arriving) {
+  Sample outgoing[SAMPLE_BATCH_CAPACITY];
+  uint8_t sent = batch.peek(outgoing, count);
+  unsigned long from = batch.position();
+  pushSamples(batch, next, arriving);
+  batch.consume(from, sent);
+}
+
+void setup() {
+  printf("SampleBatch peek/consume with pushes in between\n");
+
+  {
+    SampleBatch batch(policy);
+    uint32_t next = 0;
+    pushSamples(batch, next, 10);
+    sendWhilePushing(batch, next, SAMPLE_BATCH_CAPACITY, 5);
+    expect("5 arrive during a send of 10", batch, 10, 5);
+  }
+
+  {
+    // the cloud was down, the buffer is full and all of it goes out, 7 more push the 7 oldest in flight out
+    SampleBatch batch(policy);
+    uint32_t next = 0;
+    pushSamples(batch, next, SAMPLE_BATCH_CAPACITY);
+    sendWhilePushing(batch, next, SAMPLE_BATCH_CAPACITY, 7);
+    expect("7 arrive during a send of a full buffer", batch, SAMPLE_BATCH_CAPACITY, 7);
+  }
+
+  {
+    // more arrive than the buffer holds, everything that was sent is already gone
+    SampleBatch batch(policy);
+    uint32_t next = 0;
+    pushSamples(batch, next, 20);
+    sendWhilePushing(batch, next, SAMPLE_BATCH_CAPACITY, SAMPLE_BATCH_CAPACITY + 3);
+    expect("a full buffer arrives during a send of 20", batch, 23, SAMPLE_BATCH_CAPACITY);
+  }
+
+  {
+    // only part of the buffer goes out
+    SampleBatch batch(policy);
+    uint32_t next = 0;
+    pushSamples(batch, next, 30);
+    sendWhilePushing(batch, next, 16, 40);
+    expect("40 arrive during a send of the oldest 16 of 30", batch, 16, 54);
+  }
+
+  printf(failures == 0 ? "PASS\n" : "FAIL: %d cases\n", failures);
+  exit(failures == 0 ? 0 : 1);
+}
+
+void loop() {
+}
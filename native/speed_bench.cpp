@@ -0,0 +1,123 @@
+// speed_bench - compares the two ways the TTGO has read its speed potentiometer, on the host: a blocking
+// analogRead() and a float scale on every loop() pass (what loop() used to do) against SpeedSampler, the I2S
+// DMA stream averaged and filtered by a background task (what it does now). For each it prints the CPU the
+// process used and how much the speed loop() sees jitters with a constant input and ADC noise
+//
+//   g++ -O2 -std=gnu++17 -pthread -Inative/NativeHal -Ilib/SpeedSampler native/speed_bench.cpp
+//       lib/SpeedSampler/SpeedSampler.cpp native/NativeHal/NativeHal.cpp -o speed_bench
+//   echo "analog 36 2048" | NATIVE_ADC_NOISE=60 ./speed_bench
+//
+// The input is set over stdin like for the firmware, NATIVE_ADC_NOISE defaults to 60 counts here. The loop
+// sleeps LOOP_US between passes like NativeHal's main() does, an empty loop is measured first so what the
+// loop costs on its own can be told apart. It exits non-zero if the sampler doesn't use less CPU and jitter
+// less than analogRead() does
+
+#include <SpeedSampler.h>
+
+#include <math.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+#define SPEED_PIN 36
+#define SPEED_CHANNEL ADC1_CHANNEL_0
+
+// how long each way is run, how often the speed is looked at meanwhile (the TTGO's fastest send) and the
+// pause between loop() passes
+#define RUN_MS 3000
+#define SAMPLE_EVERY_MS 100
+#define LOOP_US 100
+
+typedef struct run_result {
+  double cpu = 0;       // share of one core the process used
+  double meanMph = 0;
+  double sdMph = 0;     // of the speed taken every SAMPLE_EVERY_MS
+  int minMph = 0;
+  int maxMph = 0;
+  unsigned long passes = 0;
+} run_result;
+
+static double cpuSeconds() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// runs a loop() for RUN_MS whose pass reads the speed with read, keeping what it reads every SAMPLE_EVERY_MS
+template <typename Read>
+static run_result run(Read read) {
+  run_result result;
+  std::vector<int> speeds;
+  double cpuStart = cpuSeconds();
+  unsigned long start = millis();
+  unsigned long nextSample = start;
+  int speed = 0;
+  while (millis() - start < RUN_MS) {
+    speed = read();
+    if ((long) (millis() - nextSample) >= 0) {
+      speeds.push_back(speed);
+      nextSample += SAMPLE_EVERY_MS;
+    }
+    result.passes++;
+    usleep(LOOP_US);
+  }
+  result.cpu = (cpuSeconds() - cpuStart) / ((millis() - start) / 1000.0);
+
+  double sum = 0, squares = 0;
+  result.minMph = result.maxMph = speeds.empty() ? 0 : speeds[0];
+  for (int value : speeds) {
+    sum += value;
+    squares += value * value;
+    result.minMph = min(result.minMph, value);
+    result.maxMph = max(result.maxMph, value);
+  }
+  if (!speeds.empty()) {
+    result.meanMph = sum / speeds.size();
+    result.sdMph = sqrt(max(squares / speeds.size() - result.meanMph * result.meanMph, 0.0));
+  }
+  return result;
+}
+
+static void report(const char *name, const run_result &result, const run_result &empty) {
+  printf("  %-26s %5.1f%% CPU (%+5.1f%% over an empty loop), %lu passes, speed %.2f mph, sd %.2f mph, "
+         "range %d-%d mph\n", name, result.cpu * 100, (result.cpu - empty.cpu) * 100, result.passes,
+         result.meanMph, result.sdMph, result.minMph, result.maxMph);
+}
+
+void setup() {
+  // noise has to be set before the first ADC reading, NativeHal reads it once
+  setenv("NATIVE_ADC_NOISE", "60", 0);
+
+  // give the stdin thread a moment to set the input
+  delay(200);
+  if (analogRead(SPEED_PIN) < 2 * atoi(getenv("NATIVE_ADC_NOISE"))) {
+    printf("FAIL: set the input away from 0 first, e.g. echo \"analog %d 2048\" | ./speed_bench\n", SPEED_PIN);
+    exit(2);
+  }
+
+  printf("Speed input, %d ms each, %s counts of ADC noise\n", RUN_MS, getenv("NATIVE_ADC_NOISE"));
+  run_result empty = run([]() { return 0; });
+  report("empty loop", empty, empty);
+
+  // the old loop(): a conversion and a float scale every pass, the newest one is what gets sent
+  run_result single = run([]() { return (int) (analogRead(SPEED_PIN) / 4095.0 * 100); });
+  report("analogRead() every pass", single, empty);
+
+  // the sampler's task keeps running once started, so it goes last
+  static SpeedSampler sampler;
+  if (!sampler.begin(SPEED_CHANNEL)) {
+    printf("FAIL: SpeedSampler didn't start\n");
+    exit(1);
+  }
+  delay(200);
+  run_result dma = run([]() { return (int) sampler.speed(); });
+  report("SpeedSampler (I2S DMA)", dma, empty);
+  printf("  %lu DMA blocks filtered\n", sampler.blocks());
+
+  bool ok = dma.cpu < single.cpu && dma.sdMph <= single.sdMph;
+  printf(ok ? "PASS\n" : "FAIL: the sampler should cost less CPU and jitter less\n");
+  exit(ok ? 0 : 1);
+}
+
+void loop() {
+}
@@ -0,0 +1,167 @@
+// spsc_stress - hammers SpscQueue from two threads on the host, the way the ESP-NOW callback and loop() use it,
+// and checks every item comes out once, whole and in order. Exits non-zero if one doesn't
+//
+//   g++ -O2 -std=gnu++17 -pthread -Ilib/SpscQueue native/spsc_stress.cpp -o spsc_stress
+//   ./spsc_stress [millions of items, default 10]
+//
+// Build with -fsanitize=thread as well to have the memory ordering checked, not just the results
+//
+// Two runs:
+//   - lossless: the producer retries while the queue is full, so every item has to arrive
+//   - bursts: the producer pushes in bursts bigger than the queue and never waits (like OnDataRecv), the
+//     consumer is slowed down now and then. Whatever doesn't arrive has to be counted in dropped(), and what
+//     does arrive still has to be in order
+
+#include <SpscQueue.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+// same capacity as the gateway's frame queue
+#define QUEUE_SIZE 64
+
+// items in a burst, and how often the consumer stops for a while in the bursts run
+#define BURST_ITEMS 100
+#define CONSUMER_STALL_EVERY 50000
+#define CONSUMER_STALL_US 200
+
+// about the size of the gateway's raw_frame, so a torn copy would show in the payload
+typedef struct stress_item {
+  uint64_t sequence;
+  uint8_t payload[32];  // every byte derived from sequence
+  uint64_t check;       // sequence again, written last
+} stress_item;
+
+static stress_item makeItem(uint64_t sequence) {
+  stress_item item;
+  item.sequence = sequence;
+  for (size_t i = 0; i < sizeof(item.payload); i++) {
+    item.payload[i] = (uint8_t) (sequence * 31 + i);
+  }
+  item.check = sequence;
+  return item;
+}
+
+static bool whole(const stress_item &item) {
+  if (item.check != item.sequence) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(item.payload); i++) {
+    if (item.payload[i] != (uint8_t) (item.sequence * 31 + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+typedef struct run_result {
+  uint64_t pushed = 0;      // push() calls that returned true
+  uint64_t popped = 0;
+  uint64_t torn = 0;        // items that came out with a payload from another one
+  uint64_t outOfOrder = 0;  // items not newer than the one before
+  uint64_t skipped = 0;     // sequence numbers that never came out
+  unsigned long dropped = 0;  // the queue's count of pushes it refused because it was full
+  double seconds = 0;
+} run_result;
+
+static run_result run(uint64_t items, bool lossless) {
+  SpscQueue<stress_item, QUEUE_SIZE> *queue = new SpscQueue<stress_item, QUEUE_SIZE>();
+  std::atomic<bool> done{false};
+  run_result result;
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    uint64_t sequence = 0;
+    while (sequence < items) {
+      if (lossless) {
+        while (!queue->push(makeItem(sequence))) {
+          // full, let the consumer catch up
+          std::this_thread::yield();
+        }
+        result.pushed++;
+        sequence++;
+      } else {
+        for (int i = 0; i < BURST_ITEMS && sequence < items; i++, sequence++) {
+          if (queue->push(makeItem(sequence))) {
+            result.pushed++;
+          }
+        }
+        std::this_thread::yield();
+      }
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  std::thread consumer([&]() {
+    stress_item item = {};
+    int64_t last = -1;
+    while (true) {
+      // read before popping, so an empty queue after the producer was done really is the end
+      bool finished = done.load(std::memory_order_acquire);
+      if (!queue->pop(item)) {
+        if (finished) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+
+      result.popped++;
+      if (!whole(item)) {
+        result.torn++;
+      }
+      if ((int64_t) item.sequence <= last) {
+        result.outOfOrder++;
+      } else {
+        result.skipped += item.sequence - last - 1;
+        last = item.sequence;
+      }
+      if (!lossless && result.popped % CONSUMER_STALL_EVERY == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(CONSUMER_STALL_US));
+      }
+    }
+    result.skipped += items - 1 - last;
+  });
+
+  producer.join();
+  consumer.join();
+  std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+  result.seconds = took.count();
+  result.dropped = queue->dropped();
+  delete queue;
+  return result;
+}
+
+// prints a run and whether it holds up, items is how many the producer offered
+static bool report(const char *name, const run_result &result, uint64_t items, bool lossless) {
+  printf("%s: %llu offered, %llu pushed, %llu popped, %lu refused full, %llu torn, %llu out of order, %llu missing "
+         "(%.1f M items/s)\n", name, (unsigned long long) items, (unsigned long long) result.pushed,
+         (unsigned long long) result.popped, result.dropped, (unsigned long long) result.torn,
+         (unsigned long long) result.outOfOrder, (unsigned long long) result.skipped,
+         result.popped / result.seconds / 1e6);
+
+  bool ok = result.torn == 0 && result.outOfOrder == 0 && result.popped == result.pushed &&
+            result.skipped == items - result.pushed;
+  if (lossless) {
+    ok = ok && result.popped == items;
+  } else {
+    // every push that failed is a counted drop, and nothing else went missing
+    ok = ok && result.dropped == items - result.pushed;
+  }
+  printf("  %s\n", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint64_t items = (argc > 1 ? strtoull(argv[1], NULL, 10) : 10) * 1000000ULL;
+
+  bool ok = report("lossless", run(items, true), items, true);
+  ok = report("bursts", run(items, false), items, false) && ok;
+
+  printf(ok ? "PASS\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
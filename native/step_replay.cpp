@@ -0,0 +1,278 @@
+// step_replay - replays recorded LSM6DSO traces through the step counting code on the host
+//
+// A trace is the serial output of a step counter built with -DLSM6DSO_PRINT_SAMPLES, every sample as an
+// "imu,<index>,<x>,<y>,<z>" line (anything else in it is skipped). From a board: pio device monitor > walk.log,
+// from the native build: type "imu walk" etc. into it and keep stdout. Count the steps (and jumps) while
+// recording and give the counts after the file name
+//
+//   g++ -O2 -std=gnu++17 -Inative/NativeHal -Ilib/Lsm6dsoFifo -Ilib/AccelKernel -Ilib/StepDetector
+//       -Ilib/MotionClassifier native/step_replay.cpp lib/AccelKernel/AccelKernel.cpp
+//       lib/StepDetector/StepDetector.cpp lib/MotionClassifier/MotionClassifier.cpp -o step_replay
+//   ./step_replay walk.log:54 still.log:0 jumps.log:0:18
+//
+// native/traces has labelled traces to run it on (see the README there). It exits non-zero if a check fails:
+// the kernel disagreeing with the float path beyond rounding, an empty trace, or a count given after the file
+// name missed by more than COUNT_TOLERANCE (the detector's only on traces with no jumps, it counts those too)
+//
+// For each trace it
+//   - checks the integer kernel (AccelKernel) makes the same above/below call as the float magnitude it
+//     replaced, over a sweep of thresholds (only samples within float rounding of a threshold may come out
+//     differently), and times both paths in ns per sample
+//   - runs the StepDetector over it the way the firmware does (one FIFO burst at a time) and prints how soon
+//     after boot it started counting, when the first step came and how the count compares with the real one
+//   - runs the footfalls through the MotionClassifier like Lab 5 does and compares the steps and jumps it
+//     found with the real ones, class by class
+
+#include <AccelKernel.h>
+#include <StepDetector.h>
+#include <MotionClassifier.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// thresholds swept for the equivalence check, in g
+#define SWEEP_FROM 0.5f
+#define SWEEP_TO   4.0f
+#define SWEEP_STEP 0.001f
+
+// a sample the two paths call differently has to be this close to the threshold (float rounding), anything
+// further out is a real difference
+#define ROUNDING_G 1e-5f
+
+// passes over the trace for the timing
+#define BENCH_PASSES 200
+
+// how far off a count may be and still pass, a share of the real count but at least one
+#define COUNT_TOLERANCE 0.05
+
+static std::vector<ImuSample> loadTrace(const char *path) {
+  std::vector<ImuSample> samples;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    unsigned long index;
+    int x, y, z;
+    if (sscanf(line.c_str(), "imu,%lu,%d,%d,%d", &index, &x, &y, &z) == 4) {
+      samples.push_back({(uint32_t) index, (int16_t) x, (int16_t) y, (int16_t) z});
+    }
+  }
+  return samples;
+}
+
+// the float magnitude get_magnitude() used to compute
+static float floatMagnitude(const ImuSample &sample) {
+  float ax = Lsm6dsoFifo::toG(sample.x);
+  float ay = Lsm6dsoFifo::toG(sample.y);
+  float az = Lsm6dsoFifo::toG(sample.z);
+
+  return sqrt(pow(ax, 2) + pow(ay, 2) + pow(az, 2));
+}
+
+// samples the two paths call differently, summed over the threshold sweep, and the furthest any of them was
+// from the threshold
+static unsigned long compare(const std::vector<ImuSample> &samples, unsigned long &checked, float &furthest) {
+  std::vector<uint32_t> squared(samples.size());
+  accelSquaredMagnitudes(samples.data(), samples.size(), squared.data());
+
+  unsigned long differ = 0;
+  checked = 0;
+  furthest = 0;
+  for (float threshold = SWEEP_FROM; threshold <= SWEEP_TO; threshold += SWEEP_STEP) {
+    uint32_t thresholdSquared = accelThresholdSquared(threshold);
+    for (size_t first = 0; first < samples.size(); first += LSM6DSO_BURST_WORDS) {
+      size_t n = std::min(samples.size() - first, (size_t) LSM6DSO_BURST_WORDS);
+      uint32_t above = accelAboveMask(&squared[first], n, thresholdSquared);
+      for (size_t i = 0; i < n; i++) {
+        bool kernel = (above >> i) & 1;
+        float magnitude = floatMagnitude(samples[first + i]);
+        if (kernel != (magnitude > threshold)) {
+          differ++;
+          furthest = std::max(furthest, fabsf(magnitude - threshold));
+        }
+      }
+      checked += n;
+    }
+  }
+  return differ;
+}
+
+// whether a count is close enough to the real one, prints why not. expected -1 if it isn't known
+static bool checkCount(const char *what, unsigned long found, long expected) {
+  if (expected < 0) {
+    return true;
+  }
+  long allowed = std::max(1L, (long) (expected * COUNT_TOLERANCE));
+  if (labs((long) found - expected) > allowed) {
+    printf("  FAIL: %lu %s, should be %ld give or take %ld\n", found, what, expected, allowed);
+    return false;
+  }
+  return true;
+}
+
+static double nsPerSample(std::chrono::steady_clock::time_point start, size_t samples) {
+  std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+  return took.count() / ((double) samples * BENCH_PASSES);
+}
+
+// same work as loop(): one block at a time, how many samples are above the threshold
+static void bench(const std::vector<ImuSample> &samples, float threshold) {
+  volatile unsigned long sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < BENCH_PASSES; pass++) {
+    unsigned long above = 0;
+    for (const ImuSample &sample : samples) {
+      above += floatMagnitude(sample) > threshold;
+    }
+    sink = sink + above;
+  }
+  double floatNs = nsPerSample(start, samples.size());
+
+  uint32_t thresholdSquared = accelThresholdSquared(threshold);
+  uint32_t squared[LSM6DSO_BURST_WORDS];
+  start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < BENCH_PASSES; pass++) {
+    unsigned long above = 0;
+    for (size_t first = 0; first < samples.size(); first += LSM6DSO_BURST_WORDS) {
+      size_t n = std::min(samples.size() - first, (size_t) LSM6DSO_BURST_WORDS);
+      accelSquaredMagnitudes(&samples[first], n, squared);
+      above += __builtin_popcount(accelAboveMask(squared, n, thresholdSquared));
+    }
+    sink = sink + above;
+  }
+  double kernelNs = nsPerSample(start, samples.size());
+
+  printf("  float sqrt(pow()) %6.2f ns/sample, integer kernel %6.2f ns/sample (%.1fx)\n", floatNs, kernelNs,
+         floatNs / kernelNs);
+}
+
+// the step counter's loop(): the trace in bursts through accelSquaredMagnitudes() and the detector. expected
+// is the real number of steps, -1 if it isn't known. Returns the steps it counted
+static unsigned long detect(const std::vector<ImuSample> &samples, long expected) {
+  StepDetector detector;
+  uint32_t squared[LSM6DSO_BURST_WORDS];
+  StepEvent events[LSM6DSO_BURST_WORDS];
+  long firstStep = -1;
+  for (size_t first = 0; first < samples.size(); first += LSM6DSO_BURST_WORDS) {
+    size_t n = std::min(samples.size() - first, (size_t) LSM6DSO_BURST_WORDS);
+    accelSquaredMagnitudes(&samples[first], n, squared);
+    if (detector.feed(&samples[first], squared, n, events) > 0 && firstStep < 0) {
+      firstStep = events[0].index;
+    }
+  }
+
+  const StepDetectorStats &stats = detector.stats();
+  printf("  detector counting after %.2f s, ", stats.readyIndex / (float) LSM6DSO_ODR_HZ);
+  if (firstStep >= 0) {
+    printf("first step at %.2f s, ", firstStep / (float) LSM6DSO_ODR_HZ);
+  }
+  printf("%lu steps", stats.steps);
+  if (expected > 0) {
+    printf(" of %ld (%.1f%% off)", expected, fabs((double) stats.steps - expected) * 100.0 / expected);
+  } else if (expected == 0) {
+    printf(" of 0 (%lu false)", stats.steps);
+  }
+  printf(", %lu rises inside the refractory window\n", stats.refractory);
+  return stats.steps;
+}
+
+// how far a count is from the real one, expected -1 if that isn't known
+static void printCount(const char *what, unsigned long found, long expected) {
+  printf("%lu %s", found, what);
+  if (expected > 0) {
+    printf(" of %ld (%.1f%% detected, %ld extra)", expected,
+           std::min(found, (unsigned long) expected) * 100.0 / expected, std::max((long) found - expected, 0L));
+  } else if (expected == 0) {
+    printf(" of 0 (%lu false)", found);
+  }
+}
+
+// Lab 5's loop(): footfalls from the detector sorted into steps and jumps, one burst at a time. Returns whether
+// both counts are close enough
+static bool classify(const std::vector<ImuSample> &samples, long expectedSteps, long expectedJumps) {
+  StepDetector detector;
+  MotionClassifier classifier;
+  uint32_t squared[LSM6DSO_BURST_WORDS];
+  StepEvent footfalls[LSM6DSO_BURST_WORDS];
+  MotionEvent events[MOTION_MAX_EVENTS];
+  float airtime = 0;
+  for (size_t first = 0; first < samples.size(); first += LSM6DSO_BURST_WORDS) {
+    size_t n = std::min(samples.size() - first, (size_t) LSM6DSO_BURST_WORDS);
+    accelSquaredMagnitudes(&samples[first], n, squared);
+    size_t found = detector.feed(&samples[first], squared, n, footfalls);
+    size_t classified = classifier.feed(&samples[first], n, footfalls, found, events);
+    for (size_t i = 0; i < classified; i++) {
+      airtime += events[i].airtime;
+    }
+  }
+
+  const MotionClassifierStats &stats = classifier.stats();
+  printf("  classifier: ");
+  printCount("steps", stats.steps, expectedSteps);
+  printf(", ");
+  printCount("jumps", stats.jumps, expectedJumps);
+  printf("\n  %lu footfalls were jumps, %lu push offs and %lu hops weren't, %lu soft landings, %zu held at the end",
+         stats.absorbed, stats.pushes, stats.hops, stats.softLandings, classifier.held());
+  if (stats.jumps > 0) {
+    printf(", %.2f s in the air per jump", airtime / stats.jumps);
+  }
+  printf("\n");
+  bool ok = checkCount("classified steps", stats.steps, expectedSteps);
+  return checkCount("jumps", stats.jumps, expectedJumps) && ok;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s trace.log[:steps[:jumps]]...\n", argv[0]);
+    return 2;
+  }
+
+  int status = 0;
+  for (int i = 1; i < argc; i++) {
+    std::string path = argv[i];
+    long expected = -1;
+    long expectedJumps = -1;
+    size_t colon = path.find(':');
+    if (colon != std::string::npos) {
+      const char *counts = path.c_str() + colon + 1;
+      expected = atol(counts);
+      if (strchr(counts, ':') != NULL) {
+        expectedJumps = atol(strchr(counts, ':') + 1);
+      }
+      path.resize(colon);
+    }
+
+    std::vector<ImuSample> samples = loadTrace(path.c_str());
+    printf("%s: %zu samples (%.1f s)\n", path.c_str(), samples.size(), samples.size() / (float) LSM6DSO_ODR_HZ);
+    if (samples.empty()) {
+      printf("  FAIL: no samples in it\n");
+      status = 1;
+      continue;
+    }
+
+    unsigned long checked;
+    float furthest;
+    unsigned long differ = compare(samples, checked, furthest);
+    printf("  %lu of %lu threshold tests differ (thresholds %.3f-%.3f g), all within %g g of the threshold\n",
+           differ, checked, SWEEP_FROM, SWEEP_TO, furthest);
+    if (furthest > ROUNDING_G) {
+      printf("  FAIL: further from the threshold than float rounding explains\n");
+      status = 1;
+    }
+    bench(samples, 1.2f);
+    // the detector can't tell a jump's push off and landing from steps, so its count is only checked when
+    // there were no jumps
+    unsigned long steps = detect(samples, expected);
+    if (expectedJumps <= 0 && !checkCount("detector steps", steps, expected)) {
+      status = 1;
+    }
+    if (!classify(samples, expected, expectedJumps)) {
+      status = 1;
+    }
+  }
+  printf(status == 0 ? "PASS\n" : "FAIL\n");
+  return status;
+}
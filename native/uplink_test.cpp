@@ -0,0 +1,183 @@
+// uplink_test - checks on the host that Uplink::poll() never holds up loop() when the server is slow: a local
+// server answers late, dribbles its response out a byte at a time, never answers or hangs up, and the test
+// keeps calling poll() the way loop() does. Each case has to end with the right result, every poll() call has
+// to come back within POLL_LIMIT_US and the loop has to keep turning the whole time. Exits non-zero if not
+//
+//   g++ -std=gnu++17 -pthread -Inative/NativeHal -Ilib/Uplink native/uplink_test.cpp lib/Uplink/Uplink.cpp
+//       native/NativeHal/NativeHal.cpp -o uplink_test
+//   ./uplink_test < /dev/null
+
+#include <Uplink.h>
+#include <WiFi.h>
+
+#include <arpa/inet.h>
+#include <functional>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// a poll() taking longer than this counts as blocking. Parsing what has arrived takes microseconds, this leaves
+// room for the scheduler taking the core away on a busy machine
+#define POLL_LIMIT_US 10000
+
+// the firmware's loop() between two polls, and how many of those have to fit into a case (a blocked loop would
+// manage a handful)
+#define LOOP_MS 1
+#define MIN_LOOP_SHARE 0.5
+
+// the Uplink gives up on a response after this long without a byte
+#define TIMEOUT_MS 2000
+
+// how long a case may run before it counts as stuck
+#define CASE_LIMIT_MS 5000
+
+static const char RESPONSE[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok";
+
+static int failures = 0;
+static int listener = -1;
+static uint16_t port = 0;
+
+// what the server does with a connection once it has read the request
+typedef std::function<void(int fd)> ServerBehaviour;
+
+static void sleepMs(unsigned long ms) {
+  usleep(ms * 1000);
+}
+
+static void sendAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+// the stand-in server: one connection, read the GET request up to its blank line, then do what the case says
+static void serve(ServerBehaviour behaviour) {
+  int fd = accept(listener, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  std::string request;
+  char buffer[256];
+  while (request.find("\r\n\r\n") == std::string::npos) {
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      break;
+    }
+    request.append(buffer, n);
+  }
+  behaviour(fd);
+  close(fd);
+}
+
+// one request against a server behaving like that, polled like loop() would until it's answered. expected is
+// what poll() has to end with and minMs how soon it may at the earliest
+static void expect(const char *name, ServerBehaviour behaviour, int expected, unsigned long minMs,
+                   const char *body = NULL) {
+  std::thread server(serve, behaviour);
+  WiFiClient client;
+  Uplink uplink(client, IPAddress(127, 0, 0, 1), port, "localhost", TIMEOUT_MS);
+
+  int result = UPLINK_WAITING;
+  unsigned long loops = 0;
+  unsigned long longestUs = 0;
+  unsigned long start = millis();
+  if (uplink.get("/slow")) {
+    while (result == UPLINK_WAITING && millis() - start < CASE_LIMIT_MS) {
+      unsigned long before = micros();
+      result = uplink.poll();
+      longestUs = max(longestUs, micros() - before);
+      loops++;
+      sleepMs(LOOP_MS);
+    }
+  } else {
+    result = UPLINK_ERROR_CONNECTION_FAILED;
+  }
+  unsigned long took = millis() - start;
+  std::string received = uplink.body();
+  uplink.stop();
+  server.join();
+
+  printf("  %s: %d after %lu ms, %lu loops meanwhile, longest poll %lu us\n", name, result, took, loops,
+         longestUs);
+  if (result != expected) {
+    printf("    FAIL: should be %d\n", expected);
+    failures++;
+  }
+  if (took < minMs) {
+    printf("    FAIL: should take at least %lu ms\n", minMs);
+    failures++;
+  }
+  if (longestUs > POLL_LIMIT_US) {
+    printf("    FAIL: a poll() took over %d us\n", POLL_LIMIT_US);
+    failures++;
+  }
+  if (loops < took / LOOP_MS * MIN_LOOP_SHARE) {
+    printf("    FAIL: the loop stalled, it should have turned at least %lu times\n",
+           (unsigned long) (took / LOOP_MS * MIN_LOOP_SHARE));
+    failures++;
+  }
+  if (body != NULL && result > 0 && received != body) {
+    printf("    FAIL: body \"%s\", should be \"%s\"\n", received.c_str(), body);
+    failures++;
+  }
+}
+
+void setup() {
+  // straight to the stand-in, not wherever NATIVE_SERVER points
+  unsetenv("NATIVE_SERVER");
+
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (listener < 0 || bind(listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 1) != 0 ||
+      getsockname(listener, (sockaddr *) &address, &length) != 0) {
+    printf("FAIL: can't listen on the loopback\n");
+    exit(1);
+  }
+  port = ntohs(address.sin_port);
+
+  printf("Uplink against a slow server\n");
+  expect("answers at once", [](int fd) {
+    sendAll(fd, RESPONSE, strlen(RESPONSE));
+    sleepMs(100);
+  }, 200, 0, "ok");
+
+  expect("answers after 1.5 s", [](int fd) {
+    sleepMs(1500);
+    sendAll(fd, RESPONSE, strlen(RESPONSE));
+    sleepMs(100);
+  }, 200, 1500, "ok");
+
+  // one byte every 20 ms keeps the timeout from running out, the response takes ~1.3 s in all
+  expect("dribbles the response out", [](int fd) {
+    for (size_t i = 0; i < strlen(RESPONSE); i++) {
+      sendAll(fd, RESPONSE + i, 1);
+      sleepMs(20);
+    }
+    sleepMs(100);
+  }, 200, 20 * (sizeof(RESPONSE) - 2), "ok");
+
+  expect("never answers", [](int fd) {
+    sleepMs(TIMEOUT_MS + 500);
+  }, UPLINK_ERROR_TIMED_OUT, TIMEOUT_MS);
+
+  expect("hangs up after 0.5 s", [](int fd) {
+    sleepMs(500);
+  }, UPLINK_ERROR_CONNECTION_FAILED, 500);
+
+  close(listener);
+  printf(failures == 0 ? "PASS\n" : "FAIL: %d checks\n", failures);
+  exit(failures == 0 ? 0 : 1);
+}
+
+void loop() {
+}